@@ -1,3 +1,7 @@
+#if !defined(_POSIX_C_SOURCE) && !defined(_WIN32)
+#define _POSIX_C_SOURCE 199506L
+#endif
+
 #include "ss.h"
 #include <stdbool.h>
 #include <stdint.h>
@@ -6,53 +10,170 @@
 #include <string.h>
 #include <assert.h>
 #include <stdio.h>
+#include <time.h>
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#define ss_X86
+#include <immintrin.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#elif !defined(ss_NO_THREADS)
+#include <pthread.h>
+#endif
 
 /********************************* Core Types *********************************/
 typedef struct ss_Map      ss_Map;
 typedef struct ss_List     ss_List;
-typedef struct ss_Iter     ss_Iter;
 typedef struct ss_Stream   ss_Stream;
 typedef struct ss_Buffer   ss_Buffer;
 typedef struct ss_Object   ss_Object;
 typedef enum   ss_Type     ss_Type;
+typedef enum   ss_Kind     ss_Kind;
 typedef struct ss_Compiler ss_Compiler;
+typedef struct ss_First    ss_First;
+typedef struct ss_ByteSet  ss_ByteSet;
+typedef struct ss_Span     ss_Span;
+typedef struct ss_Filter   ss_Filter;
+typedef struct ss_Heap     ss_Heap;
 
-typedef ss_Match*  (*ss_Matcher)( ss_Context* ctx, ss_Pattern* pat, ss_Map* scope, ss_Stream* stream );
+typedef ss_Match*  (*ss_Matcher)( ss_Context* ctx, ss_Pattern* pat, size_t scope, ss_Stream* stream );
 typedef void       (*ss_Cleaner)( ss_Context* ctx, ss_Pattern* pat );
 
+typedef char const* (*ss_SpanKernel)( ss_ByteSet const* set, char const* loc, char const* end );
+typedef char const* (*ss_TeddyKernel)( ss_Filter const* filter, char const* loc, char const* end );
+
+enum ss_Kind {
+    KIND_ALL_OF,
+    KIND_ONE_OF,
+    KIND_HAS_NEXT,
+    KIND_NOT_NEXT,
+    KIND_ZERO_OR_ONE,
+    KIND_ZERO_OR_MORE,
+    KIND_JUST_ONE,
+    KIND_ONE_OR_MORE,
+    KIND_COUNT,
+    KIND_LITERAL,
+    KIND_CLASS
+};
+
 struct ss_Pattern {
+    ss_Kind     kind;
+    unsigned    depth;
     ss_Matcher  match;
     ss_Cleaner  clean;
     char*       binding;
+    ss_Filter*  filter;
 };
 
+/* An `open` stream's input may continue past `end`, so reading there
+   suspends matching instead of ending the input. */
 struct ss_Stream {
     ss_Context* ctx;
+    ss_Format   fmt;
     char const* loc;
     char const* end;
+    bool        open;
     long       (*read)( ss_Context* ctx, ss_Stream* stream );
 };
 
+/* A match made along the way that something may look for once matching
+   is done: one bound to `site`, a pattern's binding string, in scope
+   `scope`, or with no site a copy of a bound repetition, following copy
+   `prev`.  The match carries scope `own`, and a repetition's run has
+   `count` copies ending at copy `items`.  Scopes are numbered from one
+   as they're opened, zero being none, and copies by their place in the
+   log plus one, zero being none. */
+typedef struct {
+    char const* site;
+    size_t      scope;
+    size_t      prev;
+    char const* loc;
+    char const* end;
+    size_t      own;
+    size_t      count;
+    size_t      items;
+} ss_Capture;
+
+/* The matches logged so far, oldest first, and how many scopes have
+   been opened.  Abandoning part of a match drops what it logged by
+   cutting `count` back. */
+typedef struct {
+    ss_Capture* caps;
+    size_t      count;
+    size_t      cap;
+    size_t      scopes;
+} ss_Log;
+
 struct ss_Context {
+    ss_Heap*    heap;
     ss_Map*     patterns;
     ss_Error    errnum;
     char const* errmsg;
+    char const* errloc;
+    unsigned    maxdepth;
     
     size_t      tmpcap;
     size_t      tmptop;
-    char const* tmpbuf;
+    char*       tmpbuf;
+    
+    size_t        maxsteps;
+    unsigned long maxtime;
+    size_t        steps;
+    size_t        ticks;
+    size_t        chunk;
+    uint64_t      deadline;
+    bool          halted;
+    
+    ss_Feed*      feed;
+    bool          starved;
+    
+    ss_Match*     token;
+    ss_Capture    last;
+    ss_Log        log;
+    bool          bare;
 };
 
+/* Scanners over a reader keep a window of its input in a feed, which
+   starts `base` bytes into the input and has the next attempt `at`
+   bytes in.  Scanners over slices have the next attempt `at` bytes into
+   `slice`, which starts `sliceBase` bytes into the input, and `str` and
+   `base` say where the last match's input starts.  Scanners over a
+   text have `str` at the start of the text. */
 struct ss_Scanner {
-    ss_Pattern* pat;
-    ss_Stream   stream;
+    ss_Pattern*      pat;
+    ss_Filter const* filter;
+    char const*      need;
+    ss_Stream        stream;
+    char const*      str;
+    ss_Reader        read;
+    void*            data;
+    ss_Feed*         feed;
+    uint64_t         base;
+    size_t           at;
+    bool             eof;
+    ss_Slice const*  slices;
+    size_t           count;
+    size_t           slice;
+    uint64_t         sliceBase;
+    uint64_t         total;
 };
 
+/* Matches of a bound repetition keep the matches of each copy of its
+   body in `items`, in order.  A match handed out by ss_match() or
+   ss_find() keeps what was logged while it was matched in `caps` until
+   something looks for it, when it's made into the match's scope and
+   copies.  The pattern may be gone by then, so the entries are followed
+   by a copy of each one's binding string. */
 struct ss_Match {
     ss_Map*     scope;
-    ss_Match*   next;
+    size_t      count;
+    ss_Match**  items;
     char const* loc;
     char const* end;
+    ss_Capture* caps;
+    size_t      ncaps;
 };
 
 struct ss_Compiler {
@@ -60,6 +181,7 @@ struct ss_Compiler {
     ss_Stream   stream;
     long        ch1;
     long        ch2;
+    unsigned    nesting;
 };
 
 enum ss_Type {
@@ -71,7 +193,9 @@ enum ss_Type {
     TYPE_LIST,
     TYPE_BUFFER,
     TYPE_COMPILER,
-    TYPE_ITER,
+    TYPE_BINDING,
+    TYPE_LAYOUT,
+    TYPE_FEED,
     TYPE_LAST
 };
 
@@ -81,10 +205,185 @@ struct ss_Object {
     char     data[];
 };
 
+/* Everything libss allocates for a context comes from its heap, which
+   counts the bytes in use against an optional limit.  A context's heap
+   outlives it until the last of its blocks is released. */
+struct ss_Heap {
+    ss_Allocator alloc;
+    bool         system;
+    bool         orphaned;
+    size_t       used;
+    size_t       limit;
+    size_t       failed;
+};
+
+/* A binding path resolved by ss_bind().  Each step holds the hash of the
+   name it looks up, the patterns that can bind that name in the scope
+   reached so far (by their binding strings, which scopes remember), and
+   which of a repetition's copies to pick if `indexed` is set. */
+typedef struct {
+    unsigned     hash;
+    bool         indexed;
+    size_t       index;
+    size_t       nsites;
+    char const** sites;
+} ss_BindStep;
+
+struct ss_Binding {
+    ss_Pattern*  pat;
+    size_t       nsteps;
+    ss_BindStep* steps;
+};
+
+/* How far a matcher had got when a feed's input ran out.  Sequences
+   keep the part they were on (`index`) and where it started (`at`),
+   alternations the alternative they were trying, repetitions how many
+   copies they'd matched, how many they'd kept and the last of those,
+   the scope of the first and where the next one starts, and scoped
+   matches the scope their bindings were going into.  Alternations and
+   scoped matches also keep where in the log what they've bound starts
+   (`mark`).  Each is found again by the kind of matcher, the pattern
+   and where its match starts (`loc`). */
+typedef enum {
+    FRAME_ALL_OF,
+    FRAME_ONE_OF,
+    FRAME_REPEAT,
+    FRAME_SCOPE
+} ss_FrameKind;
+
+typedef struct {
+    ss_FrameKind kind;
+    ss_Pattern*  pat;
+    char const*  loc;
+    char const*  at;
+    size_t       index;
+    size_t       mark;
+    size_t       scope;
+    size_t       count;
+    size_t       last;
+} ss_Frame;
+
+typedef struct {
+    ss_Frame* frames;
+    size_t    count;
+    size_t    cap;
+} ss_Frames;
+
+/* A match that's given its input a piece at a time.  Frames are saved
+   innermost first as matching unwinds, so the outermost is on top of
+   `saved` when the next piece is matched, and each matcher on the way
+   back down takes its own off as it's reached.  What the match has
+   logged so far waits in `log`. */
+struct ss_Feed {
+    ss_Pattern* pat;
+    ss_Format   fmt;
+    char*       buf;
+    size_t      len;
+    size_t      cap;
+    bool        ended;
+    bool        decided;
+    ss_Match*   match;
+    ss_Frames   saved;
+    ss_Frames   next;
+    ss_Log      log;
+};
+
+/* The set of symbols a pattern can start with.  Symbols below 256
+   are tracked individually, anything above is lumped into `wide`,
+   and `empty` is set when the pattern can succeed without consuming
+   anything (so it has to be attempted regardless of the next symbol). */
+struct ss_First {
+    uint32_t bits[8];
+    bool     wide;
+    bool     empty;
+};
+
+/* A set of bytes kept both as a bitmap and, where it fits, as a few
+   inclusive ranges that the span `kernel` can test in parallel. */
+#define SPAN_RANGES 4
+struct ss_ByteSet {
+    uint32_t      bits[8];
+    int           stop;
+    unsigned      nranges;
+    unsigned char lo[SPAN_RANGES];
+    unsigned char hi[SPAN_RANGES];
+    ss_SpanKernel kernel;
+};
+
+/* A character class that repetitions can consume in bulk.  Byte
+   streams use `bytes` directly, character streams run `ascii` over
+   the single byte characters and decode anything else, testing it
+   against `bytes` (for symbols below 256) or against `wide` and the
+   `ranges` borrowed from the class the span was made from.  If
+   `stoplen` is non-zero the run also ends at the first occurrence of
+   `stop`, as it does for the `{ ~'-->' char }` idiom. */
+struct ss_Span {
+    bool        wide;
+    size_t      nranges;
+    long const* ranges;
+    ss_ByteSet  bytes;
+    ss_ByteSet  ascii;
+    size_t      stoplen;
+    long        stop[];
+};
+
+/* What ss_find() knows about where matches of a pattern can start in
+   input of a particular format, worked out when the pattern is compiled.
+   If `skip` is set, `starts` holds every byte a match can't start with,
+   so a span over it lands on the next candidate.  A non-zero `teddy`
+   gives the width of the nibble masks for a Teddy style search over the
+   leading bytes of up to TEDDY_LITERALS literals, one of which every
+   match starts with; literal `i` sets bit `i % 8` in the masks of each
+   of its leading bytes.  The search is run by `kernel`, or left to the
+   byte skip if there's no kernel for this machine.  The first `needed`
+   bytes of `need` are part of a literal every match contains, so input
+   without them can't match.  Every match is between `shortest` and
+   `longest` bytes long, the latter being SIZE_MAX if there's no limit,
+   and ends with the `tail` bytes of `ending`.  If the pattern is a
+   sequence, `rest` holds the fewest and most bytes the parts after each
+   of its `steps` parts can consume, so an anchored match can give up as
+   soon as the end of the input is out of reach.  Only the top-level
+   parts are checked: a part that's an alternation or repetition commits
+   to the first way it matches, so a bound crossed inside one can't tell
+   the part failing and trying something shorter from the whole match
+   failing.  Matches only need a scope if `scoped` is set, meaning
+   something in the pattern binds. */
+#define TEDDY_LITERALS 32
+#define TEDDY_WIDTH    3
+#define NEED_WIDTH     16
+struct ss_Filter {
+    bool           skip;
+    ss_ByteSet     starts;
+    unsigned       teddy;
+    ss_TeddyKernel kernel;
+    unsigned char  lo[TEDDY_WIDTH][16];
+    unsigned char  hi[TEDDY_WIDTH][16];
+    size_t         needed;
+    char           need[NEED_WIDTH];
+    size_t         shortest;
+    size_t         longest;
+    size_t         tail;
+    char           ending[NEED_WIDTH];
+    size_t         steps;
+    size_t*        rest;
+    bool           scoped;
+};
+
+#define ss_bitGet( BITS, I ) ( ( (BITS)[(I) >> 5] >> ((I) & 31) ) & 1 )
+#define ss_bitSet( BITS, I ) ( (BITS)[(I) >> 5] |= (uint32_t)1 << ((I) & 31) )
+
 /********************************* Prototypes *********************************/
 
 
-static void* ss_alloc( size_t sz, ss_Type type );
+static ss_Heap* heapNew( ss_Allocator const* allocator );
+static void     heapFree( ss_Heap* heap );
+static void*    heapObject( ss_Heap* heap, size_t sz, ss_Type type );
+
+static void* ss_malloc( ss_Heap* heap, size_t sz );
+static void* ss_calloc( ss_Heap* heap, size_t nmem, size_t size );
+static void* ss_realloc( ss_Heap* heap, void* ptr, size_t sz );
+static void  ss_dealloc( void* ptr );
+static void* ss_alloc( ss_Context* ctx, size_t sz, ss_Type type );
 static void* ss_refer( void* ptr );
 static void  ss_free( void* ptr );
 
@@ -93,15 +392,15 @@ static void ss_error( ss_Context* ctx, ss_Error err, char const* fmt, ... );
 
 static ss_Map*  ss_mapNew( ss_Context* ctx );
 static int      ss_mapPut( ss_Context* ctx, ss_Map* map, char const* key, void* val );
+static int      ss_mapPutSite( ss_Context* ctx, ss_Map* map, char const* key, char const* site, void* val );
 static void*    ss_mapGet( ss_Context* ctx, ss_Map* map, char const* key );
 static int      ss_mapCommit( ss_Context* ctx, ss_Map* map );
 static void     ss_mapCancel( ss_Context* ctx, ss_Map* map );
+static void*    ss_mapSite( ss_Context* ctx, ss_Map* map, unsigned hash, char const** sites, size_t count );
+static unsigned ss_mapHash( char const* key );
 
 static ss_List* ss_listNew( ss_Context* ctx );
 static int      ss_listAdd( ss_Context* ctx, ss_List* list, void* val );
-static ss_Iter* ss_listIter( ss_Context* ctx, ss_List* list );
-
-static void* ss_iterNext( ss_Context* ctx, ss_Iter* iter );
 
 static ss_Buffer*  ss_bufferNew( ss_Context* ctx );
 static int         ss_bufferPut( ss_Context* ctx, ss_Buffer* buf, long ch );
@@ -116,49 +415,202 @@ static ss_Pattern* ss_zeroOrOnePattern( ss_Context* ctx, ss_Pattern* pattern );
 static ss_Pattern* ss_zeroOrMorePattern( ss_Context* ctx, ss_Pattern* pattern );
 static ss_Pattern* ss_justOnePattern( ss_Context* ctx, ss_Pattern* pattern );
 static ss_Pattern* ss_oneOrMorePattern( ss_Context* ctx, ss_Pattern* pattern );
+static ss_Pattern* ss_countPattern( ss_Context* ctx, ss_Pattern* pattern, size_t min, size_t max );
 static ss_Pattern* ss_literalPattern( ss_Context* ctx, long const* str, size_t len );
+static ss_Pattern* ss_classPattern( ss_Context* ctx, int (*test)( int ch ), bool wide );
+static ss_Pattern* ss_rangePattern( ss_Context* ctx, long lo, long hi );
+static ss_Pattern* ss_unionPattern( ss_Context* ctx, ss_Pattern** alts, size_t count );
+
+static char const* filterSkip( ss_Filter const* filter, char const* loc, char const* end );
+static char const* filterNeed( ss_Filter const* filter, char const* loc, char const* end );
+static ss_Match*   allOfWalk( ss_Context* ctx, ss_Pattern* p, size_t scope, ss_Stream* stream, size_t const* rest );
+static ss_Match*   scopedMatch( ss_Context* ctx, ss_Pattern* pat, bool scoped, ss_Stream* stream );
+static ss_Match*   newMatch( ss_Context* ctx, size_t scope, char const* loc, char const* end );
+static ss_Match*   matchResult( ss_Context* ctx, ss_Match* token );
+static int         matchBuild( ss_Context* ctx, ss_Match* match );
+static ss_Match*   readerFind( ss_Context* ctx, ss_Scanner* scanner );
+static ss_Match*   slicesFind( ss_Context* ctx, ss_Scanner* scanner );
+
+static unsigned    ss_listDepth( ss_List* patterns );
+static bool        ss_binds( ss_Pattern* pat );
+static long        ss_symbolOf( ss_Pattern* pat );
+static ss_Pattern* ss_symbolsOf( ss_Pattern* pat );
+static long const* ss_stringOf( ss_Pattern* pat, size_t* len );
+static void        ss_first( ss_Pattern* pat, ss_First* first );
+static ss_Span*    ss_spanOf( ss_Context* ctx, ss_Pattern* pat );
+static size_t      ss_sitesOf( ss_Pattern* pat, char const* name, size_t len, ss_Pattern** sites, size_t max );
+static ss_Pattern* ss_bodyOf( ss_Pattern* pat );
+static void        ss_lengthOf( ss_Pattern* pat, ss_Format fmt, size_t* min, size_t* max );
+static void        ss_filter( ss_Context* ctx, ss_Pattern* pat, ss_Format fmt, ss_Filter* filter );
+
+static ss_Pattern* ss_layout( ss_Context* ctx, ss_Pattern* pat );
 
 /****************************** Context Creation ******************************/
+
+/* Matching recurses once per level of pattern nesting, and so does
+   the compiler, so limiting how deep a pattern can be nested bounds
+   the native stack either of them can use.  The default keeps both
+   well within a 256KB thread stack. */
+#define ss_DEPTH_LIMIT 512
+
 ss_Context* ss_init( void ) {
-    ss_Context* ctx = ss_alloc( sizeof(ss_Context), TYPE_CONTEXT );
-    if( !ctx )
+    return ss_initWith( NULL );
+}
+
+ss_Context* ss_initWith( ss_Allocator const* allocator ) {
+    ss_Heap* heap = heapNew( allocator );
+    if( !heap )
+        return NULL;
+    
+    ss_Context* ctx = heapObject( heap, sizeof(ss_Context), TYPE_CONTEXT );
+    if( !ctx ) {
+        heapFree( heap );
         return NULL;
+    }
     
-    ctx->patterns = ss_mapNew();
+    ctx->heap     = heap;
+    ctx->patterns = NULL;
     ctx->errnum   = ss_ERR_NONE;
     ctx->errmsg   = NULL;
+    ctx->errloc   = NULL;
+    ctx->maxdepth = ss_DEPTH_LIMIT;
+    
+    ctx->maxsteps = 0;
+    ctx->maxtime  = 0;
+    ctx->halted   = false;
+    ctx->feed     = NULL;
+    ctx->starved  = false;
+    ctx->token    = NULL;
+    ctx->last     = (ss_Capture){ 0 };
+    ctx->log      = (ss_Log){ 0 };
+    ctx->bare     = false;
     
     ctx->tmpcap = 64;
     ctx->tmptop = 0;
-    ctx->tmpbuf = malloc( 64 );
+    ctx->tmpbuf = ss_malloc( heap, 64 );
     if( !ctx->tmpbuf ) {
         ss_release( ctx );
-        ss_error( ctx, ss_ERR_ALLOC, NULL );
         return NULL;
     }
     
+    ctx->patterns = ss_mapNew( ctx );
+    if( !ctx->patterns ) {
+        ss_release( ctx );
+        return NULL;
+    }
+    
+    ctx->token = ss_alloc( ctx, sizeof(ss_Match), TYPE_MATCH );
+    if( !ctx->token ) {
+        ss_release( ctx );
+        return NULL;
+    }
+    *ctx->token = (ss_Match){ 0 };
+    
     ss_prelude( ctx );
     return ctx;
 }
 
+void ss_limitDepth( ss_Context* ctx, unsigned depth ) {
+    ctx->maxdepth = depth;
+}
+
+/* Allocations that would take the context's heap past `bytes` fail as
+   if the allocator had run out, with ss_ERR_ALLOC.  Zero means no
+   limit.  Blocks made for the context count against it until they're
+   released, whichever context they're later used with. */
+void ss_limitMemory( ss_Context* ctx, size_t bytes ) {
+    ctx->heap->limit = bytes;
+}
+
+size_t ss_memoryUsed( ss_Context* ctx ) {
+    return ctx->heap->used;
+}
+
+/* Each call to ss_match() or ss_find() may invoke at most `steps`
+   matchers, and take at most `micros` microseconds, before giving up
+   with ss_ERR_TIMEOUT.  Zero means no limit. */
+void ss_limitSteps( ss_Context* ctx, size_t steps ) {
+    ctx->maxsteps = steps;
+}
+
+void ss_limitTime( ss_Context* ctx, unsigned long micros ) {
+    ctx->maxtime = micros;
+}
+
 static void freeContext( void* ptr ) {
     ss_Context* ctx = ptr;
-    if( ctx->pattern )
+    if( ctx->patterns )
         ss_release( ctx->patterns );
     if( ctx->tmpbuf )
-        free( tmpbuf );
+        ss_dealloc( ctx->tmpbuf );
+    if( ctx->token )
+        ss_release( ctx->token );
+    ss_dealloc( ctx->log.caps );
+    ctx->heap->orphaned = true;
     ss_free( ctx );
 }
 
+static void ss_error( ss_Context* ctx, ss_Error err, char const* fmt, ... ) {
+    ctx->errnum = err;
+    if( fmt ) {
+        ctx->errmsg = fmt;
+        return;
+    }
+    switch( err ) {
+        case ss_ERR_ALLOC:     ctx->errmsg = "Allocation error"; break;
+        case ss_ERR_FORMAT:    ctx->errmsg = "Format error"; break;
+        case ss_ERR_SYNTAX:    ctx->errmsg = "Syntax error"; break;
+        case ss_ERR_UNDEFINED: ctx->errmsg = "Undefined pattern"; break;
+        case ss_ERR_DEPTH:     ctx->errmsg = "Pattern is nested too deeply"; break;
+        case ss_ERR_TIMEOUT:   ctx->errmsg = "Matching took too long"; break;
+        case ss_ERR_MORE:      ctx->errmsg = "More input is needed"; break;
+        case ss_ERR_IO:        ctx->errmsg = "Input could not be read"; break;
+        default:               ctx->errmsg = "Error"; break;
+    }
+}
+
+ss_Error ss_errnum( ss_Context* ctx ) {
+    return ctx->errnum;
+}
+
+char const* ss_errmsg( ss_Context* ctx ) {
+    return ctx->errmsg;
+}
+
+/* Where in the input matching was when it ran out of steps or time, or
+   the path of the file ss_scanFiles() failed on. */
+char const* ss_errloc( ss_Context* ctx ) {
+    return ctx->errloc;
+}
+
+void ss_errclr( ss_Context* ctx ) {
+    ctx->errnum = ss_ERR_NONE;
+    ctx->errmsg = NULL;
+    ctx->errloc = NULL;
+}
+
 /***************************** String Decoding ********************************/
 #define ss_STREAM_END (-1)
 #define ss_STREAM_ERR (-2)
 
+/* Reading past the end of an open stream can't say what comes next, so
+   matching unwinds as it does when it runs out of time, and the feed
+   waits for more input. */
+static long ss_starve( ss_Context* ctx ) {
+    if( !ctx->halted ) {
+        ctx->steps  -= ctx->chunk - ctx->ticks;
+        ctx->starved = true;
+        ctx->halted  = true;
+        ctx->ticks   = 1;
+    }
+    return ss_STREAM_END;
+}
+
 static long readByte( ss_Context* ctx, ss_Stream* stream ) {
     if( stream->loc == stream->end )
-        return ss_STREAM_END;
+        return stream->open ? ss_starve( ctx ) : ss_STREAM_END;
     else
-        return *(stream->loc++);
+        return (unsigned char)*(stream->loc++);
 }
 
 #define isSingleChr( c ) ( (unsigned char)(c) >> 7 == 0  )
@@ -169,10 +621,10 @@ static long readByte( ss_Context* ctx, ss_Stream* stream ) {
 static long readChar( ss_Context* ctx, ss_Stream* stream ) {
     
     if( stream->loc == stream->end )
-        return ss_STREAM_END;
+        return stream->open ? ss_starve( ctx ) : ss_STREAM_END;
     
     long code = 0;
-    int  byte = *( stream->loc++ );
+    int  byte = (unsigned char)*( stream->loc++ );
     int  size = 0;
     if( isSingleChr( byte ) ) {
         size = 1;
@@ -194,13 +646,13 @@ static long readChar( ss_Context* ctx, ss_Stream* stream ) {
         code = byte & 0x7;
     }
     else {
-        ss_error( ctx, "Input is corrupted or not formated as UTF-8" );
-        return ss_STREAM_ERROR;
+        ss_error( ctx, ss_ERR_FORMAT, "Input is corrupted or not formated as UTF-8" );
+        return ss_STREAM_ERR;
     }
     
     for( int i = 1 ; i < size ; i++ ) {
         if( stream->loc == stream->end )
-            return ss_STREAM_END;
+            return stream->open ? ss_starve( ctx ) : ss_STREAM_END;
         
         byte = *( stream->loc++ );
         code = ( code << 6 ) | ( byte & 0x3F );
@@ -209,8 +661,22 @@ static long readChar( ss_Context* ctx, ss_Stream* stream ) {
     return code;
 }
 
+/* The bytes taken by the symbol starting with `byte`, which is where
+   readChar() would leave off after it. */
+static size_t symbolSize( ss_Format fmt, char byte ) {
+    if( fmt == ss_CHARS ) {
+        if( isDoubleChr( byte ) )
+            return 2;
+        if( isTripleChr( byte ) )
+            return 3;
+        if( isQuadChr( byte ) )
+            return 4;
+    }
+    return 1;
+}
+
 static ss_Stream ss_makeStream( ss_Format fmt, char const* loc, char const* end ) {
-    ss_Stream stream = { .loc = loc, .end = end };
+    ss_Stream stream = { .fmt = fmt, .loc = loc, .end = end };
     
     switch( fmt ) {
         case ss_BYTES:
@@ -229,7 +695,7 @@ static ss_Stream ss_makeStream( ss_Format fmt, char const* loc, char const* end
 
 static int ss_advance( ss_Context* ctx, ss_Compiler* compiler ) {
     compiler->ch1 = compiler->ch2;
-    compiler->ch2 = compiler->stream.read( &compiler->stream );
+    compiler->ch2 = compiler->stream.read( ctx, &compiler->stream );
     if( compiler->ch2 == ss_STREAM_ERR )
         return ss_STREAM_ERR;
     else
@@ -237,13 +703,14 @@ static int ss_advance( ss_Context* ctx, ss_Compiler* compiler ) {
 }
 
 static ss_Compiler* ss_compiler( ss_Context* ctx, ss_Format fmt, char const* str, size_t len ) {
-    ss_Compiler* compiler = ss_alloc( sizeof(ss_Compiler), TYPE_COMPILER );
+    ss_Compiler* compiler = ss_alloc( ctx, sizeof(ss_Compiler), TYPE_COMPILER );
     if( !compiler ) {
         ss_error( ctx, ss_ERR_ALLOC, NULL );
         return NULL;
     }
     
     compiler->stream   = ss_makeStream( fmt, str, str + len );
+    compiler->nesting  = 0;
     compiler->patterns = ss_listNew( ctx );
     if( !compiler->patterns ) {
         ss_release( compiler );
@@ -264,9 +731,12 @@ static void freeCompiler( void* ptr ) {
     ss_free( compiler );
 }
 
-static void ss_whitespace( ss_Context* ctx, ss_Compiler* compiler ) {
-    while( isspace( compiler->ch1 ) && !ss_advance( ctx, compiler ) )
-        ;
+static int ss_whitespace( ss_Context* ctx, ss_Compiler* compiler ) {
+    while( compiler->ch1 >= 0 && compiler->ch1 < 256 && isspace( compiler->ch1 ) ) {
+        if( ss_advance( ctx, compiler ) )
+            return ss_STREAM_ERR;
+    }
+    return 0;
 }
 
 
@@ -319,19 +789,19 @@ static ss_Pattern* ss_compileText( ss_Context* ctx, ss_Compiler* compiler ) {
         return NULL;
     
     while( !isbreak( compiler->ch1, compiler->ch2 ) && !isend( compiler->ch1 ) ) {
-        if( ss_bufferPut( buf, compiler->ch1 ) ) {
+        if( ss_bufferPut( ctx, buf, compiler->ch1 ) ) {
             ss_release( buf );
             return NULL;
         }
-        if( ss_advance( ctx, compiler ) {
+        if( ss_advance( ctx, compiler ) ) {
             ss_release( buf );
             return NULL;
         }
     }
     
-    long const* str = ss_bufferBuf( buf );
-    size_t      len = ss_bufferLen( buf );
-    ss_Pattern* pat = ss_literalPattern( str, len );
+    long const* str = ss_bufferBuf( ctx, buf );
+    size_t      len = ss_bufferLen( ctx, buf );
+    ss_Pattern* pat = ss_literalPattern( ctx, str, len );
     
     ss_release( buf );
     
@@ -354,11 +824,11 @@ static ss_Pattern* ss_compileString( ss_Context* ctx, ss_Compiler* compiler ) {
     
     while( compiler->ch1 != quote ) {
         if( isend( compiler->ch1 ) ) {
-            ss_error( ctx, "Unterminated string" );
+            ss_error( ctx, ss_ERR_SYNTAX, "Unterminated string" );
             ss_release( buf );
             return NULL;
         }
-        if( ss_bufferPut( buf, compiler->ch1 ) ) {
+        if( ss_bufferPut( ctx, buf, compiler->ch1 ) ) {
             ss_release( buf );
             return NULL;
         }
@@ -374,9 +844,9 @@ static ss_Pattern* ss_compileString( ss_Context* ctx, ss_Compiler* compiler ) {
         return NULL;
     }
     
-    long const* str = ss_bufferBuf( buf );
-    size_t      len = ss_bufferLen( buf );
-    ss_Pattern* pat = ss_literalPattern( str, len );
+    long const* str = ss_bufferBuf( ctx, buf );
+    size_t      len = ss_bufferLen( ctx, buf );
+    ss_Pattern* pat = ss_literalPattern( ctx, str, len );
     
     ss_release( buf );
     
@@ -394,39 +864,64 @@ static ss_Pattern* ss_compileChar( ss_Context* ctx, ss_Compiler* compiler ) {
     if( ss_advance( ctx, compiler ) )
         return NULL;
     
-    return ss_literalPattern( &chr, 1 );
+    return ss_literalPattern( ctx, &chr, 1 );
 }
 
+/* Character codes are given in decimal, or in hex with a `0x` prefix. */
+#define ss_CODE_MAX 0x10FFFF
 static ss_Pattern* ss_compileCode( ss_Context* ctx, ss_Compiler* compiler ) {
     if( !isdigit( compiler->ch1 ) )
         return NULL;
     
+    int base = 10;
+    if( compiler->ch1 == '0' && ( compiler->ch2 == 'x' || compiler->ch2 == 'X' ) ) {
+        base = 16;
+        if( ss_advance( ctx, compiler ) || ss_advance( ctx, compiler ) )
+            return NULL;
+        if( !isxdigit( compiler->ch1 ) ) {
+            ss_error( ctx, ss_ERR_SYNTAX, "Expected hex digits in character code" );
+            return NULL;
+        }
+    }
+    
     long code = 0;
-    while( isalnum( compiler->ch1 ) ) {
-        if( !isdigit( compiler->ch1 ) ) {
+    while( compiler->ch1 >= 0 && compiler->ch1 < 128 && isalnum( compiler->ch1 ) ) {
+        long digit;
+        if( isdigit( compiler->ch1 ) )
+            digit = compiler->ch1 - '0';
+        else
+        if( base == 16 && isxdigit( compiler->ch1 ) )
+            digit = tolower( compiler->ch1 ) - 'a' + 10;
+        else {
             ss_error( ctx, ss_ERR_SYNTAX, "Non-digit at end of character code" );
             return NULL;
         }
-        code = code*10 + (compiler->ch1 - '0');
+        
+        code = code*base + digit;
+        if( code > ss_CODE_MAX ) {
+            ss_error( ctx, ss_ERR_SYNTAX, "Character code out of range" );
+            return NULL;
+        }
         
         if( ss_advance( ctx, compiler ) )
             return NULL;
     }
     
-    return ss_literalPattern( &code, 1 );
+    return ss_literalPattern( ctx, &code, 1 );
 }
 
 static char const* parseName( ss_Context* ctx, ss_Compiler* compiler ) {
     ctx->tmptop = 0;
     
-    while( compiler->ch1 == '_' || isalnum( compiler->ch1 ) ) {
+    while( compiler->ch1 == '_' || ( compiler->ch1 >= 0 && compiler->ch1 < 128 && isalnum( compiler->ch1 ) ) ) {
         if( ctx->tmptop >= ctx->tmpcap - 1 ) {
-            void* rep = realloc( ctx->tmpbuf );
+            void* rep = ss_realloc( ctx->heap, ctx->tmpbuf, ctx->tmpcap*2 );
             if( !rep ) {
                 ss_error( ctx, ss_ERR_ALLOC, NULL );
                 return NULL;
             }
             ctx->tmpbuf = rep;
+            ctx->tmpcap *= 2;
         }
         
         ctx->tmpbuf[ctx->tmptop++] = (char)compiler->ch1;
@@ -434,7 +929,7 @@ static char const* parseName( ss_Context* ctx, ss_Compiler* compiler ) {
             return NULL;
     }
     ctx->tmpbuf[ctx->tmptop++] = '\0';
-    return buf;
+    return ctx->tmpbuf;
 }
 
 static ss_Pattern* ss_compileNamed( ss_Context* ctx, ss_Compiler* compiler ) {
@@ -455,20 +950,20 @@ static ss_Pattern* ss_compileNamed( ss_Context* ctx, ss_Compiler* compiler ) {
             return NULL;
     }
     else {
-        name = parseName( compiler );
+        name = parseName( ctx, compiler );
         if( !name )
             return NULL;
     }
     
-    ss_Pattern* pat = ss_mapGet( compiler->ctx->patterns, name );
+    ss_Pattern* pat = ss_mapGet( ctx, ctx->patterns, name );
     if( !pat ) {
-        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        ss_error( ctx, ss_ERR_UNDEFINED, NULL );
         return NULL;
     }
     return ss_refer( pat );
 }
 
-static ss_Pattern* ss_compilePattern( ss_Compiler* compiler );
+static ss_Pattern* ss_compilePattern( ss_Context* ctx, ss_Compiler* compiler );
 
 static bool arematching( long open, long close ) {
     return (open == '(' && close == ')') ||
@@ -476,17 +971,71 @@ static bool arematching( long open, long close ) {
            (open == '[' && close == ']') ||
            (open == '<' && close == '>');
 }
-static ss_Pattern* ss_compileCompound( ss_Compiler* compiler ) {
+static int parseCount( ss_Context* ctx, ss_Compiler* compiler, size_t* count ) {
+    if( !isdigit( compiler->ch1 ) ) {
+        ss_error( ctx, ss_ERR_SYNTAX, "Expected repetition count" );
+        return -1;
+    }
+    
+    *count = 0;
+    while( isdigit( compiler->ch1 ) ) {
+        size_t digit = compiler->ch1 - '0';
+        if( *count > ( SIZE_MAX - 1 - digit )/10 ) {
+            ss_error( ctx, ss_ERR_SYNTAX, "Repetition count is too large" );
+            return -1;
+        }
+        *count = *count*10 + digit;
+        
+        if( ss_advance( ctx, compiler ) )
+            return -1;
+    }
+    return 0;
+}
+
+/* Parses the `#min`, `#min..max` or `#min..` suffix of a counted group,
+   leaving SIZE_MAX as the maximum if it's unbounded. */
+static int ss_compileCount( ss_Context* ctx, ss_Compiler* compiler, size_t* min, size_t* max ) {
+    if( ss_advance( ctx, compiler ) || parseCount( ctx, compiler, min ) )
+        return -1;
+    
+    *max = *min;
+    if( compiler->ch1 != '.' || compiler->ch2 != '.' )
+        return 0;
+    
+    if( ss_advance( ctx, compiler ) || ss_advance( ctx, compiler ) )
+        return -1;
+    
+    *max = SIZE_MAX;
+    if( !isdigit( compiler->ch1 ) )
+        return 0;
+    if( parseCount( ctx, compiler, max ) )
+        return -1;
+    
+    if( *max < *min ) {
+        ss_error( ctx, ss_ERR_SYNTAX, "Repetition count has maximum below minimum" );
+        return -1;
+    }
+    return 0;
+}
+
+static ss_Pattern* ss_compileCompound( ss_Context* ctx, ss_Compiler* compiler ) {
     long open;
     if( isopening( compiler->ch1 ) )
         open = compiler->ch1;
     else
         return NULL;
     
-    if( ss_advance( compiler ) || ss_whitespace( compiler ) )
+    if( ++compiler->nesting > ctx->maxdepth ) {
+        ss_error( ctx, ss_ERR_DEPTH, "Pattern is nested too deeply" );
+        return NULL;
+    }
+    
+    if( ss_advance( ctx, compiler ) || ss_whitespace( ctx, compiler ) )
         return NULL;
     
-    ss_List* oneOfList = ss_listNew();
+    ss_List* oneOfList = ss_listNew( ctx );
+    if( !oneOfList )
+        return NULL;
     while( !isclosing( compiler->ch1 ) ) {
         if( isend( compiler->ch1 ) ) {
             ss_error( ctx, ss_ERR_SYNTAX, "Unterminated pattern" );
@@ -494,9 +1043,13 @@ static ss_Pattern* ss_compileCompound( ss_Compiler* compiler ) {
             return NULL;
         }
         
-        ss_List* allOfList = ss_listNew();
+        ss_List* allOfList = ss_listNew( ctx );
+        if( !allOfList ) {
+            ss_release( oneOfList );
+            return NULL;
+        }
         do {
-            ss_Pattern* pat = ss_compilePattern( compiler );
+            ss_Pattern* pat = ss_compilePattern( ctx, compiler );
             if( !pat ) {
                 if( !ctx->errnum )
                     ss_error( ctx, ss_ERR_SYNTAX, "Expected sub-pattern" );
@@ -504,46 +1057,71 @@ static ss_Pattern* ss_compileCompound( ss_Compiler* compiler ) {
                 ss_release( allOfList );
                 return NULL;
             }
-            ss_listAdd( allOfList, pat );
-            ss_whitespace( compiler );
+            int added = ss_listAdd( ctx, allOfList, pat );
             ss_release( pat );
+            if( added ) {
+                ss_release( oneOfList );
+                ss_release( allOfList );
+                return NULL;
+            }
+            ss_whitespace( ctx, compiler );
         } while( compiler->ch1 != '|' && !isclosing( compiler->ch1 ) );
         
         if( compiler->ch1 == '|' )
-            ss_advance( compiler );
+            ss_advance( ctx, compiler );
         
-        ss_Pattern* allOfPat = ss_allOfPattern( allOfList );
-        ss_listAdd( oneOfList, allOfPat );
-        ss_whitespace( compiler );
+        ss_Pattern* allOfPat = ss_allOfPattern( ctx, allOfList );
         ss_release( allOfList );
+        if( !allOfPat ) {
+            ss_release( oneOfList );
+            return NULL;
+        }
+        int added = ss_listAdd( ctx, oneOfList, allOfPat );
         ss_release( allOfPat );
+        if( added ) {
+            ss_release( oneOfList );
+            return NULL;
+        }
+        ss_whitespace( ctx, compiler );
     }
     if( !arematching( open, compiler->ch1 ) ) {
-        compiler->ctx->error = "Mismatched brackets";
+        ss_error( ctx, ss_ERR_SYNTAX, "Mismatched brackets" );
         ss_release( oneOfList );
         return NULL;
     }
-    ss_advance( compiler );
+    ss_advance( ctx, compiler );
+    
+    compiler->nesting--;
     
-    ss_Pattern* oneOfPat = ss_oneOfPattern( oneOfList );
+    ss_Pattern* oneOfPat = ss_oneOfPattern( ctx, oneOfList );
     ss_release( oneOfList );
+    if( !oneOfPat )
+        return NULL;
     
     ss_Pattern* compPat  = NULL;
+    if( compiler->ch1 == '#' ) {
+        size_t min, max;
+        if( !ss_compileCount( ctx, compiler, &min, &max ) )
+            compPat = ss_countPattern( ctx, oneOfPat, min, max );
+        ss_release( oneOfPat );
+        return compPat;
+    }
+    
     switch( open ) {
         case '(':
-            compPat = ss_justOnePattern( oneOfPat );
+            compPat = ss_justOnePattern( ctx, oneOfPat );
             ss_release( oneOfPat );
         break;
         case '{':
-            compPat = ss_zeroOrMorePattern( oneOfPat );
+            compPat = ss_zeroOrMorePattern( ctx, oneOfPat );
             ss_release( oneOfPat );
         break;
         case '[':
-            compPat = ss_zeroOrOnePattern( oneOfPat );
+            compPat = ss_zeroOrOnePattern( ctx, oneOfPat );
             ss_release( oneOfPat );
         break;
         case '<':
-            compPat = ss_oneOrMorePattern( oneOfPat );
+            compPat = ss_oneOrMorePattern( ctx, oneOfPat );
             ss_release( oneOfPat );
         break;
         default:
@@ -553,234 +1131,919 @@ static ss_Pattern* ss_compileCompound( ss_Compiler* compiler ) {
     return compPat;
 }
 
-static ss_Pattern* ss_compilePrimitive( ss_Compiler* compiler ) {
+/* Parses the upper bound of a range like `'a'..'z'` or `0x4E00..0x9FFF`,
+   whose lower bound has already been compiled as `lower`. */
+static ss_Pattern* ss_compileRange( ss_Context* ctx, ss_Compiler* compiler, ss_Pattern* lower ) {
+    long lo = ss_symbolOf( lower );
+    ss_release( lower );
+    
+    if( ss_advance( ctx, compiler ) || ss_advance( ctx, compiler ) )
+        return NULL;
+    
+    ss_Pattern* upper = ss_compileString( ctx, compiler );
+    if( !upper && !ctx->errnum )
+        upper = ss_compileChar( ctx, compiler );
+    if( !upper && !ctx->errnum )
+        upper = ss_compileCode( ctx, compiler );
+    if( !upper ) {
+        if( !ctx->errnum )
+            ss_error( ctx, ss_ERR_SYNTAX, "Expected end of range" );
+        return NULL;
+    }
+    long hi = ss_symbolOf( upper );
+    ss_release( upper );
+    
+    if( lo < 0 || hi < 0 ) {
+        ss_error( ctx, ss_ERR_SYNTAX, "Range bounds must be single symbols" );
+        return NULL;
+    }
+    if( hi < lo ) {
+        ss_error( ctx, ss_ERR_SYNTAX, "Range ends before it starts" );
+        return NULL;
+    }
+    return ss_rangePattern( ctx, lo, hi );
+}
+
+static ss_Pattern* ss_compilePrimitive( ss_Context* ctx, ss_Compiler* compiler ) {
     ss_Pattern* pat = NULL;
-    pat = ss_compileString( compiler );
+    pat = ss_compileString( ctx, compiler );
     if( pat )
-        goto parsed;
-    pat = ss_compileChar( compiler );
+        goto symbol;
+    pat = ss_compileChar( ctx, compiler );
     if( pat )
-        goto parsed;
-    pat = ss_compileCode( compiler );
+        goto symbol;
+    pat = ss_compileCode( ctx, compiler );
     if( pat )
-        goto parsed;
-    pat = ss_compileCompound( compiler );
+        goto symbol;
+    pat = ss_compileCompound( ctx, compiler );
     if( pat )
         goto parsed;
     return NULL;
 
+symbol:
+
+    if( compiler->ch1 == '.' && compiler->ch2 == '.' ) {
+        pat = ss_compileRange( ctx, compiler, pat );
+        if( !pat )
+            return NULL;
+    }
+
 parsed:
 
     if( compiler->ch1 != ':' )
         return pat;
     
-    ss_advance( compiler );
+    if( ss_advance( ctx, compiler ) ) {
+        ss_release( pat );
+        return NULL;
+    }
     
-    char const* binding = parseName( compiler );
+    char const* binding = parseName( ctx, compiler );
     if( !binding ) {
         ss_release( pat );
-        compiler->ctx->error = "Invalid binding name";
+        ss_error( ctx, ss_ERR_SYNTAX, "Invalid binding name" );
         return NULL;
     }
     
     size_t len = strlen( binding );
-    char*  cpy = xmalloc( len + 1 );
+    char*  cpy = ss_malloc( ctx->heap, len + 1 );
+    if( !cpy ) {
+        ss_release( pat );
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        return NULL;
+    }
     strcpy( cpy, binding );
     pat->binding = cpy;
     return pat;
 }
 
-static ss_Pattern* ss_compileNotNext( ss_Compiler* compiler ) {
+static ss_Pattern* ss_compileNotNext( ss_Context* ctx, ss_Compiler* compiler ) {
     if( compiler->ch1 != '~' )
         return NULL;
-    ss_advance( compiler );
-    ss_whitespace( compiler );
+    if( ss_advance( ctx, compiler ) || ss_whitespace( ctx, compiler ) )
+        return NULL;
     
-    ss_Pattern* pat = ss_compilePrimitive( compiler );
+    ss_Pattern* pat = ss_compilePrimitive( ctx, compiler );
     if( !pat ) {
-        if( !compiler->ctx->error )
-            compiler->ctx->error = "Expected sub-pattern";
+        if( !ctx->errnum )
+            ss_error( ctx, ss_ERR_SYNTAX, "Expected sub-pattern" );
         return NULL;
     }
-    ss_Pattern* notNextPat = ss_notNextPattern( pat );
+    ss_Pattern* notNextPat = ss_notNextPattern( ctx, pat );
     ss_release( pat );
     return notNextPat;
 }
 
-static ss_Pattern* ss_compileHasNext( ss_Compiler* compiler ) {
+static ss_Pattern* ss_compileHasNext( ss_Context* ctx, ss_Compiler* compiler ) {
     if( compiler->ch1 != '^' )
         return NULL;
-    ss_advance( compiler );
-    ss_whitespace( compiler );
+    if( ss_advance( ctx, compiler ) || ss_whitespace( ctx, compiler ) )
+        return NULL;
     
-    ss_Pattern* pat = ss_compilePrimitive( compiler );
+    ss_Pattern* pat = ss_compilePrimitive( ctx, compiler );
     if( !pat ) {
-        if( !compiler->ctx->error )
-            compiler->ctx->error = "Expected sub-pattern";
+        if( !ctx->errnum )
+            ss_error( ctx, ss_ERR_SYNTAX, "Expected sub-pattern" );
         return NULL;
     }
-    ss_Pattern* hasNextPat = ss_hasNextPattern( pat );
+    ss_Pattern* hasNextPat = ss_hasNextPattern( ctx, pat );
     ss_release( pat );
     return hasNextPat;
 }
 
-static ss_Pattern* ss_compilePattern( ss_Compiler* compiler ) {
-    ss_Pattern* pat = ss_compilePrimitive( compiler );
-    if( pat || compiler->ctx->error )
+static ss_Pattern* ss_compilePattern( ss_Context* ctx, ss_Compiler* compiler ) {
+    ss_Pattern* pat = ss_compilePrimitive( ctx, compiler );
+    if( pat || ctx->errnum )
         return pat;
-    pat = ss_compileNotNext( compiler );
-    if( pat || compiler->ctx->error )
+    pat = ss_compileNotNext( ctx, compiler );
+    if( pat || ctx->errnum )
         return pat;
-    pat = ss_compileHasNext( compiler );
-    if( pat || compiler->ctx->error )
+    pat = ss_compileHasNext( ctx, compiler );
+    if( pat || ctx->errnum )
         return pat;
-    pat = ss_compileNamed( compiler );
-    if( pat || compiler->ctx->error )
+    pat = ss_compileNamed( ctx, compiler );
+    if( pat || ctx->errnum )
         return pat;
     return NULL;
 }
 
-static ss_Pattern* ss_compileFull( ss_Compiler* compiler ) {
-    ss_List* allOfList = ss_listNew();
+static ss_Pattern* ss_compileFull( ss_Context* ctx, ss_Compiler* compiler ) {
+    ss_List* allOfList = ss_listNew( ctx );
+    if( !allOfList )
+        return NULL;
     while( true ) {
         ss_Pattern* pat = NULL;
         
-        pat = ss_compileText( compiler );
-        if( !pat )
-            pat = ss_compilePattern( compiler );
+        pat = ss_compileText( ctx, compiler );
+        if( !pat && !ctx->errnum )
+            pat = ss_compilePattern( ctx, compiler );
         if( !pat )
             break;
         
-        ss_listAdd( allOfList, pat );
+        ss_listAdd( ctx, allOfList, pat );
         ss_release( pat );
     }
-    ss_Pattern* allOfPat = ss_allOfPattern( allOfList );
+    if( ctx->errnum ) {
+        ss_release( allOfList );
+        return NULL;
+    }
+    ss_Pattern* allOfPat = ss_allOfPattern( ctx, allOfList );
     ss_release( allOfList );
     
     return allOfPat;
 }
 
-ss_Pattern* ss_compile( ss_Context* ctx, ss_Format fmt, char const* pat, size_t len ) {
-    ss_Compiler* compiler = ss_compiler( ctx, fmt, pat, len );
-    ss_Pattern*  pattern  = ss_compileFull( compiler );
+ss_Pattern* ss_compile( ss_Context* ctx, ss_Text const* txt ) {
+    ss_Compiler* compiler = ss_compiler( ctx, txt->fmt, txt->str, txt->len );
+    if( !compiler )
+        return NULL;
+    ss_Pattern*  pattern  = ss_compileFull( ctx, compiler );
     ss_release( compiler );
+    if( !pattern )
+        return NULL;
+    
+    /* Named patterns are spliced in by reference, so the result can be
+       deeper than anything the compiler itself had to nest. */
+    if( pattern->depth > ctx->maxdepth ) {
+        ss_error( ctx, ss_ERR_DEPTH, "Pattern is nested too deeply" );
+        ss_release( pattern );
+        return NULL;
+    }
+    
+    ss_Pattern* flat = ss_layout( ctx, pattern );
+    ss_release( pattern );
+    if( !flat )
+        return NULL;
+    pattern = flat;
+    
+    pattern->filter = ss_malloc( ctx->heap, sizeof(ss_Filter)*2 );
+    if( !pattern->filter ) {
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        ss_release( pattern );
+        return NULL;
+    }
+    ss_filter( ctx, pattern, ss_BYTES, &pattern->filter[ss_BYTES] );
+    ss_filter( ctx, pattern, ss_CHARS, &pattern->filter[ss_CHARS] );
     return pattern;
 }
 
 void ss_define( ss_Context* ctx, char const* name, ss_Pattern* pat ) {
-    ss_mapPut( ctx->patterns, name, pat );
-    ss_mapCommit( ctx->patterns );
+    ss_mapPut( ctx, ctx->patterns, name, pat );
+    ss_mapCommit( ctx, ctx->patterns );
 }
 
 /********************************** Matching **********************************/
-ss_Scanner* ss_start( ss_Context* ctx, ss_Format fmt, ss_Pattern* pat, char const* str, size_t len ) {
-    ss_Scanner* scanner = ss_alloc( sizeof(ss_Scanner), TYPE_SCANNER );
-    scanner->pat = ss_refer( pat );
-    scanner->stream = ss_makeStream( fmt, str, str + len );
+
+/* The clock is read once every ss_TICK_STEPS matcher invocations while
+   a time limit is set. */
+#define ss_TICK_STEPS 1024
+
+static uint64_t ss_now( void ) {
+    #if defined(_WIN32)
+        LARGE_INTEGER freq, count;
+        QueryPerformanceFrequency( &freq );
+        QueryPerformanceCounter( &count );
+        return (uint64_t)( count.QuadPart/freq.QuadPart*1000000 + count.QuadPart%freq.QuadPart*1000000/freq.QuadPart );
+    #elif defined(CLOCK_MONOTONIC)
+        struct timespec ts;
+        clock_gettime( CLOCK_MONOTONIC, &ts );
+        return (uint64_t)ts.tv_sec*1000000 + (uint64_t)ts.tv_nsec/1000;
+    #else
+        return (uint64_t)clock()*1000000/CLOCKS_PER_SEC;
+    #endif
+}
+
+/* Sets how many steps can be taken before the limits are next checked,
+   which is never if there aren't any. */
+static void ss_rearm( ss_Context* ctx ) {
+    size_t chunk = ctx->maxtime ? ss_TICK_STEPS : SIZE_MAX;
+    if( ctx->maxsteps && ctx->steps < chunk )
+        chunk = ctx->steps;
+    ctx->chunk = chunk;
+    ctx->ticks = chunk;
+}
+
+static void ss_arm( ss_Context* ctx ) {
+    ctx->halted = false;
+    ctx->steps  = ctx->maxsteps && ctx->maxsteps < SIZE_MAX ? ctx->maxsteps + 1 : SIZE_MAX;
+    if( ctx->maxtime )
+        ctx->deadline = ss_now() + ctx->maxtime;
+    ss_rearm( ctx );
+}
+
+/* Lets matching go on once a starved stream has more input, with what's
+   left of the limits. */
+static void ss_unstarve( ss_Context* ctx ) {
+    ctx->starved = false;
+    ctx->halted  = false;
+    ss_rearm( ctx );
+}
+
+/* Called each time the steps until the next check run out.  Once the
+   limits are exceeded every later step halts too, so the matchers
+   unwind without doing any more work. */
+static bool ss_tick( ss_Context* ctx, ss_Stream const* stream ) {
+    if( !ctx->halted ) {
+        ctx->steps -= ctx->chunk;
+        if( !( ctx->maxsteps && ctx->steps == 0 ) && !( ctx->maxtime && ss_now() >= ctx->deadline ) ) {
+            ss_rearm( ctx );
+            return false;
+        }
+        ctx->halted = true;
+        ctx->errloc = stream->loc;
+    }
+    ctx->ticks = 1;
+    return true;
+}
+
+/* Counts a matcher invocation, true if matching should give up. */
+#define ss_halted( CTX, STREAM ) ( --(CTX)->ticks == 0 && ss_tick( (CTX), (STREAM) ) )
+
+static ss_Match* ss_stopped( ss_Context* ctx, ss_Match* match ) {
+    if( match )
+        ss_release( match );
+    ss_error( ctx, ss_ERR_TIMEOUT, NULL );
+    return NULL;
+}
+
+/* A match made while an allocation failed may be missing parts, or may
+   stand in for a longer one that couldn't be made, so it's dropped. */
+static ss_Match* ss_failed( ss_Context* ctx, ss_Match* match ) {
+    if( match )
+        ss_release( match );
+    ss_error( ctx, ss_ERR_ALLOC, NULL );
+    return NULL;
+}
+ss_Scanner* ss_start( ss_Context* ctx, ss_Pattern* pat, ss_Text* txt ) {
+    ss_Scanner* scanner = ss_alloc( ctx, sizeof(ss_Scanner), TYPE_SCANNER );
+    if( !scanner ) {
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        return NULL;
+    }
+    scanner->pat       = ss_refer( pat );
+    scanner->filter    = pat->filter ? &pat->filter[txt->fmt] : NULL;
+    scanner->need      = NULL;
+    scanner->stream    = ss_makeStream( txt->fmt, txt->str, txt->str + txt->len );
+    scanner->str       = txt->str;
+    scanner->read      = NULL;
+    scanner->data      = NULL;
+    scanner->feed      = NULL;
+    scanner->base      = 0;
+    scanner->at        = 0;
+    scanner->eof       = true;
+    scanner->slices    = NULL;
+    scanner->count     = 0;
+    scanner->slice     = 0;
+    scanner->sliceBase = 0;
+    scanner->total     = 0;
     return scanner;
 }
 
-ss_Match* ss_match( ss_Scanner* scanner ) {
-    ss_Stream stream = scanner->stream;
+/* Points a scanner made by ss_start() at another text, so a batch of
+   texts doesn't need a scanner for each. */
+static void scannerRewind( ss_Scanner* scanner, ss_Text const* txt ) {
+    scanner->filter = scanner->pat->filter ? &scanner->pat->filter[txt->fmt] : NULL;
+    scanner->need   = NULL;
+    scanner->stream = ss_makeStream( txt->fmt, txt->str, txt->str + txt->len );
+    scanner->str    = txt->str;
+}
+
+/* Matches the whole of the input, returning the context's token if it
+   matched.  What the filter knows about the length and ending of
+   matches is checked before anything is matched, and a sequence is
+   abandoned part way through once what's left of the input can't be
+   consumed by the parts after the current one.  Patterns that bind
+   nothing are matched without a scope. */
+static ss_Match* matchWhole( ss_Context* ctx, ss_Pattern* pat, ss_Text* txt ) {
+    ss_Filter const* filter = pat->filter ? &pat->filter[txt->fmt] : NULL;
+    size_t           failed = ctx->heap->failed;
+    if( filter ) {
+        if( txt->len < filter->shortest || txt->len > filter->longest )
+            return NULL;
+        if( txt->len < filter->tail || memcmp( txt->str + txt->len - filter->tail, filter->ending, filter->tail ) != 0 )
+            return NULL;
+        if( filterNeed( filter, txt->str, txt->str + txt->len ) == NULL )
+            return NULL;
+    }
     
-    ss_Pattern* pat   = scanner->pat;
-    ss_Map*     scope = ss_mapNew();
-    ss_Match*   match = pat->match( pat, scope, &stream );
-    ss_mapCommit( scope );
-    ss_release( scope );
-    if( stream.end == scanner->stream.end )
+    ss_Stream stream = ss_makeStream( txt->fmt, txt->str, txt->str + txt->len );
+    ss_arm( ctx );
+    ctx->log.count  = 0;
+    ctx->log.scopes = 0;
+    
+    ss_Match* match = NULL;
+    if( filter && filter->rest ) {
+        size_t scope = filter->scoped && !ctx->bare ? ++ctx->log.scopes : 0;
+        match = allOfWalk( ctx, pat, scope, &stream, filter->rest );
+    }
+    else {
+        match = scopedMatch( ctx, pat, !filter || filter->scoped, &stream );
+    }
+    if( ctx->heap->failed != failed )
+        return ss_failed( ctx, match );
+    if( ctx->halted )
+        return ss_stopped( ctx, match );
+    if( !match )
+        return NULL;
+    if( stream.loc == stream.end )
         return match;
     
     ss_release( match );
     return NULL;
 }
 
-ss_Match* ss_find( ss_Scanner* scanner ) {
-    ss_Match* m = NULL;
-    while( !m && scanner->stream.loc != scanner->stream.end ) {
-        ss_Stream stream = scanner->stream;
+/* What a match binds is only made into scopes and matches the first
+   time ss_get() or one of its relatives looks inside. */
+ss_Match* ss_match( ss_Context* ctx, ss_Pattern* pat, ss_Text* txt ) {
+    ss_Match* match = matchWhole( ctx, pat, txt );
+    return match ? matchResult( ctx, match ) : NULL;
+}
+
+/* Matches each of a batch of texts whole, as ss_match() would, setting
+   bit `i%8` of `bits[i/8]` if text `i` matched and clearing it if not.
+   Only whether each text matched is wanted, so the batch matches
+   without scopes, keeps no copies of repetitions and logs nothing, and
+   no match is made for a text that matched.  A text that raises an
+   error is left clear and the error cleared before the next text, with
+   the first error reported at the end. */
+int ss_matchMany( ss_Context* ctx, ss_Pattern* pat, ss_Text const* texts, size_t count, unsigned char* bits ) {
+    ss_Error      errnum = ss_ERR_NONE;
+    char const*   errmsg = NULL;
+    char const*   errloc = NULL;
+    unsigned char byte   = 0;
+    ctx->bare = true;
+    for( size_t i = 0 ; i < count ; i++ ) {
+        ss_Text txt = texts[i];
+        ss_errclr( ctx );
+        ctx->halted = false;
         
-        ss_Pattern* pat   = scanner->pat;
-        ss_Map*     scope = ss_mapNew();
+        ss_Match* match = matchWhole( ctx, pat, &txt );
+        if( match ) {
+            byte |= (unsigned char)( 1u << i%8 );
+            ss_release( match );
+        }
+        if( ctx->errnum && !errnum ) {
+            errnum = ctx->errnum;
+            errmsg = ctx->errmsg;
+            errloc = ctx->errloc;
+        }
+        if( i%8 == 7 || i + 1 == count ) {
+            bits[i/8] = byte;
+            byte      = 0;
+        }
+    }
+    ctx->bare = false;
+    
+    ctx->errnum = errnum;
+    ctx->errmsg = errmsg;
+    ctx->errloc = errloc;
+    return errnum ? -1 : 0;
+}
+
+/* Attempts a match at each position in turn, except that a scanner with
+   a filter skips straight over positions no match can start at, and
+   gives up once what's left of the input is too short or lacks a
+   required literal.  The last place that literal was found is kept so
+   it's only searched for again once the scanner has moved past it.
+   Scanners over a reader or slices are left to readerFind() and
+   slicesFind(). */
+ss_Match* ss_find( ss_Context* ctx, ss_Scanner* scanner ) {
+    ss_Stream* stream = &scanner->stream;
+    ss_Pattern* pat   = scanner->pat;
+    ss_Match*   m     = NULL;
+    size_t      failed = ctx->heap->failed;
+    if( scanner->read )
+        return readerFind( ctx, scanner );
+    if( scanner->slices )
+        return slicesFind( ctx, scanner );
+    
+    ss_arm( ctx );
+    while( !m && stream->loc != stream->end ) {
+        if( scanner->filter ) {
+            if( (size_t)( stream->end - stream->loc ) < scanner->filter->shortest ) {
+                stream->loc = stream->end;
+                break;
+            }
+            if( !scanner->need || scanner->need < stream->loc ) {
+                scanner->need = filterNeed( scanner->filter, stream->loc, stream->end );
+                if( !scanner->need ) {
+                    stream->loc = stream->end;
+                    break;
+                }
+            }
+            stream->loc = filterSkip( scanner->filter, stream->loc, stream->end );
+            if( stream->loc == stream->end )
+                break;
+        }
         
-        m = pat->match( pat, scope, &stream );
-        ss_mapCommit( scope );
-        ss_release( scope );
+        ss_Stream attempt = *stream;
+        bool      scoped  = !scanner->filter || scanner->filter->scoped;
+        ctx->log.count  = 0;
+        ctx->log.scopes = 0;
+        m = scopedMatch( ctx, pat, scoped, &attempt );
+        if( m )
+            m = matchResult( ctx, m );
+        if( ctx->heap->failed != failed )
+            return ss_failed( ctx, m );
+        if( ctx->halted )
+            return ss_stopped( ctx, m );
         
-        scanner->stream.read( &scanner->stream );
+        if( !m || m->end == m->loc )
+            stream->read( ctx, stream );
     }
     
     if( !m )
         return NULL;
     
-    scanner->stream.loc = m->end;
+    if( m->end > stream->loc )
+        stream->loc = m->end;
     return m;
 }
 
-ss_Match* ss_next( ss_Match* match ) {
-    return ss_refer( match->next );
+/* The number of copies of its body a bound repetition matched, zero for
+   any other match. */
+size_t ss_count( ss_Context* ctx, ss_Match* match ) {
+    if( match->caps && matchBuild( ctx, match ) )
+        return 0;
+    return match->count;
 }
 
+ss_Match* ss_getIndex( ss_Context* ctx, ss_Match* match, size_t index ) {
+    if( match->caps && matchBuild( ctx, match ) )
+        return NULL;
+    if( index >= match->count )
+        return NULL;
+    return ss_refer( match->items[index] );
+}
 
-char const* ss_loc( ss_Match* match ) {
+char const* ss_loc( ss_Context* ctx, ss_Match* match ) {
     return match->loc;
 }
 
-char const* ss_end( ss_Match* match ) {
+char const* ss_end( ss_Context* ctx, ss_Match* match ) {
     return match->end;
 }
 
-ss_Match* ss_get( ss_Match* match, char const* binding ) {
-    ss_Match* m = ss_mapGet( match->scope, binding );
+ss_Match* ss_get( ss_Context* ctx, ss_Match* match, char const* binding ) {
+    if( match->caps && matchBuild( ctx, match ) )
+        return NULL;
+    if( !match->scope )
+        return NULL;
+    ss_Match* m = ss_mapGet( ctx, match->scope, binding );
     if( m )
         return ss_refer( m );
     else
         return NULL;
 }
 
-static void freeScanner( void* ptr ) {
-    ss_Scanner* scanner = ptr;
-    ss_release( scanner->pat );
-    ss_free( scanner );
-}
-
-/****************************** Object Allocation *****************************/
-static void* xmalloc( size_t sz ) {
-    void* ptr = malloc( sz );
-    if( !ptr ) {
-        fprintf( stderr, "Allocation error\n" );
-        abort();
+/* Resolves a binding path, like `verbal.g[0].adverb`, against the
+   scopes a pattern's matches will have.  Each name is looked up in the
+   scope reached so far, and an index picks one of a repetition's
+   copies.  ss_getBound() can then follow the path from any match of the
+   pattern without hashing or comparing names. */
+ss_Binding* ss_bind( ss_Context* ctx, ss_Pattern* pat, char const* path ) {
+    size_t nsteps = 1;
+    for( char const* c = path ; *c ; c++ ) {
+        if( *c == '.' )
+            nsteps++;
     }
     
-    return ptr;
-}
-
-static void* xcalloc( size_t nmem, size_t size ) {
-    void* ptr = calloc( nmem, size );
-    if( !ptr ) {
-        fprintf( stderr, "Allocation error\n" );
-        abort();
+    ss_Binding* binding = ss_alloc( ctx, sizeof(ss_Binding), TYPE_BINDING );
+    if( !binding ) {
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        return NULL;
     }
-    return ptr;
-}
-static void* xrealloc( void* ptr, size_t sz ) {
-    void* nptr = realloc( ptr, sz );
-    if( !nptr ) {
-        free( nptr );
-        fprintf( stderr, "Allocation error\n" );
-        abort();
+    binding->pat    = ss_refer( pat );
+    binding->nsteps = 0;
+    binding->steps  = ss_calloc( ctx->heap, nsteps, sizeof(ss_BindStep) );
+    if( !binding->steps ) {
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        ss_release( binding );
+        return NULL;
     }
-    return nptr;
+    
+    ss_Pattern** bodies  = NULL;
+    size_t       nbodies = 0;
+    char const*  c       = path;
+    for( size_t i = 0 ; i < nsteps ; i++ ) {
+        char const* name = c;
+        size_t      len  = 0;
+        while( name[len] == '_' || isalnum( (unsigned char)name[len] ) )
+            len++;
+        if( len == 0 )
+            goto syntax;
+        c += len;
+        
+        size_t index   = 0;
+        bool   indexed = *c == '[';
+        if( indexed ) {
+            c++;
+            if( !isdigit( (unsigned char)*c ) )
+                goto syntax;
+            while( isdigit( (unsigned char)*c ) ) {
+                size_t digit = (size_t)( *c++ - '0' );
+                if( index > ( SIZE_MAX - digit )/10 )
+                    goto syntax;
+                index = index*10 + digit;
+            }
+            if( *c++ != ']' )
+                goto syntax;
+        }
+        if( *c++ != ( i + 1 < nsteps ? '.' : '\0' ) )
+            goto syntax;
+        
+        size_t count = 0;
+        if( i == 0 )
+            count = ss_sitesOf( pat, name, len, NULL, 0 );
+        for( size_t k = 0 ; k < nbodies ; k++ )
+            count += ss_sitesOf( bodies[k], name, len, NULL, 0 );
+        if( count == 0 ) {
+            ss_error( ctx, ss_ERR_UNDEFINED, "Pattern has no such binding" );
+            goto fail;
+        }
+        
+        ss_Pattern** found = ss_malloc( ctx->heap, sizeof(ss_Pattern*)*count );
+        ss_BindStep* step  = &binding->steps[i];
+        step->sites = ss_malloc( ctx->heap, sizeof(char const*)*count );
+        binding->nsteps++;
+        if( !found || !step->sites ) {
+            ss_dealloc( found );
+            ss_error( ctx, ss_ERR_ALLOC, NULL );
+            goto fail;
+        }
+        
+        size_t n = 0;
+        if( i == 0 )
+            n = ss_sitesOf( pat, name, len, found, count );
+        for( size_t k = 0 ; k < nbodies ; k++ )
+            n += ss_sitesOf( bodies[k], name, len, found + n, count - n );
+        
+        for( size_t k = 0 ; k < count ; k++ )
+            step->sites[k] = found[k]->binding;
+        step->nsites  = count;
+        step->indexed = indexed;
+        step->index   = index;
+        step->hash   = ss_mapHash( found[0]->binding );
+        
+        ss_dealloc( bodies );
+        bodies  = found;
+        nbodies = 0;
+        for( size_t k = 0 ; k < count ; k++ ) {
+            ss_Pattern* body = ss_bodyOf( found[k] );
+            if( body )
+                bodies[nbodies++] = body;
+        }
+    }
+    ss_dealloc( bodies );
+    return binding;
+
+syntax:
+    ss_error( ctx, ss_ERR_SYNTAX, "Invalid binding path" );
+fail:
+    ss_dealloc( bodies );
+    ss_release( binding );
+    return NULL;
+}
+
+/* Follows a binding from a match of the pattern it was resolved
+   against, returning NULL if that match didn't bind it. */
+ss_Match* ss_getBound( ss_Context* ctx, ss_Match* match, ss_Binding const* binding ) {
+    if( match->caps && matchBuild( ctx, match ) )
+        return NULL;
+    for( size_t i = 0 ; i < binding->nsteps && match ; i++ ) {
+        ss_BindStep const* step = &binding->steps[i];
+        if( !match->scope )
+            return NULL;
+        
+        match = ss_mapSite( ctx, match->scope, step->hash, step->sites, step->nsites );
+        if( match && step->indexed )
+            match = step->index < match->count ? match->items[step->index] : NULL;
+    }
+    return match ? ss_refer( match ) : NULL;
+}
+
+static void freeBinding( void* ptr ) {
+    ss_Binding* binding = ptr;
+    ss_release( binding->pat );
+    if( binding->steps ) {
+        for( size_t i = 0 ; i < binding->nsteps ; i++ )
+            ss_dealloc( binding->steps[i].sites );
+        ss_dealloc( binding->steps );
+    }
+    ss_free( binding );
+}
+
+static void freeScanner( void* ptr ) {
+    ss_Scanner* scanner = ptr;
+    if( scanner->feed )
+        ss_release( scanner->feed );
+    ss_release( scanner->pat );
+    ss_free( scanner );
+}
+
+/****************************** Object Allocation *****************************/
+
+/* Every block starts with a header naming the heap it came from and its
+   size, so it can be given back and accounted for from the pointer
+   alone. */
+typedef struct {
+    ss_Heap* heap;
+    size_t   size;
+} ss_Block;
+
+static void* sysAlloc( void* data, size_t size ) {
+    return malloc( size );
+}
+
+static void* sysResize( void* data, void* ptr, size_t size ) {
+    return realloc( ptr, size );
+}
+
+static void sysFree( void* data, void* ptr ) {
+    free( ptr );
+}
+
+static ss_Heap* heapNew( ss_Allocator const* allocator ) {
+    ss_Allocator alloc = { sysAlloc, sysResize, sysFree, NULL };
+    if( allocator )
+        alloc = *allocator;
+    
+    ss_Heap* heap = alloc.alloc( alloc.data, sizeof(ss_Heap) );
+    if( !heap )
+        return NULL;
+    heap->alloc    = alloc;
+    heap->system   = !allocator;
+    heap->orphaned = false;
+    heap->used     = 0;
+    heap->limit    = 0;
+    heap->failed   = 0;
+    return heap;
+}
+
+static void heapFree( ss_Heap* heap ) {
+    heap->alloc.free( heap->alloc.data, heap );
+}
+
+/* Counts `size` more bytes against the heap's limit, if it has one. */
+static bool heapCharge( ss_Heap* heap, size_t size ) {
+    if( heap->limit && ( size > heap->limit || heap->used > heap->limit - size ) ) {
+        heap->failed++;
+        return false;
+    }
+    heap->used += size;
+    return true;
+}
+
+static void heapRefund( ss_Heap* heap, size_t size ) {
+    heap->used -= size;
+    if( heap->orphaned && heap->used == 0 )
+        heapFree( heap );
+}
+
+static void* ss_malloc( ss_Heap* heap, size_t sz ) {
+    if( sz > SIZE_MAX - sizeof(ss_Block) || !heapCharge( heap, sizeof(ss_Block) + sz ) )
+        return NULL;
+    
+    ss_Block* blk = heap->alloc.alloc( heap->alloc.data, sizeof(ss_Block) + sz );
+    if( !blk ) {
+        heap->used -= sizeof(ss_Block) + sz;
+        heap->failed++;
+        return NULL;
+    }
+    blk->heap = heap;
+    blk->size = sz;
+    return blk + 1;
+}
+
+static void* ss_calloc( ss_Heap* heap, size_t nmem, size_t size ) {
+    if( size && nmem > SIZE_MAX/size )
+        return NULL;
+    
+    void* ptr = ss_malloc( heap, nmem*size );
+    if( ptr )
+        memset( ptr, 0, nmem*size );
+    return ptr;
+}
+
+/* Resizes a block in the heap it came from, or allocates one from `heap`
+   if `ptr` is NULL. */
+static void* ss_realloc( ss_Heap* heap, void* ptr, size_t sz ) {
+    if( !ptr )
+        return ss_malloc( heap, sz );
+    
+    ss_Block* blk = (ss_Block*)ptr - 1;
+    size_t    old = blk->size;
+    heap = blk->heap;
+    if( sz > SIZE_MAX - sizeof(ss_Block) )
+        return NULL;
+    if( sz > old && !heapCharge( heap, sz - old ) )
+        return NULL;
+    
+    ss_Block* nblk = NULL;
+    if( heap->alloc.resize ) {
+        nblk = heap->alloc.resize( heap->alloc.data, blk, sizeof(ss_Block) + sz );
+    }
+    else {
+        nblk = heap->alloc.alloc( heap->alloc.data, sizeof(ss_Block) + sz );
+        if( nblk ) {
+            memcpy( nblk, blk, sizeof(ss_Block) + ( sz < old ? sz : old ) );
+            heap->alloc.free( heap->alloc.data, blk );
+        }
+    }
+    if( !nblk ) {
+        if( sz > old )
+            heap->used -= sz - old;
+        heap->failed++;
+        return NULL;
+    }
+    if( sz < old )
+        heap->used -= old - sz;
+    nblk->size = sz;
+    return nblk + 1;
+}
+
+static void ss_dealloc( void* ptr ) {
+    if( !ptr )
+        return;
+    
+    ss_Block* blk  = (ss_Block*)ptr - 1;
+    ss_Heap*  heap = blk->heap;
+    size_t    size = sizeof(ss_Block) + blk->size;
+    heap->alloc.free( heap->alloc.data, blk );
+    heapRefund( heap, size );
+}
+
+/* Objects, map/list nodes and the first buckets of maps are put on a
+   free list for their type when released, and handed back out by the
+   next allocation of that type, so matches and the scopes built for
+   them don't go back to malloc every time.  The lists are kept per
+   thread, so pools are only used where the compiler has thread local
+   storage, and can be left out altogether by defining ss_NO_POOLS.
+   Each list holds at most ss_POOL_LIMIT blocks, and only blocks from
+   heaps using the system allocator are pooled. */
+#if !defined(ss_NO_POOLS) && defined(__GNUC__)
+#define ss_POOLS
+#define ss_LOCAL __thread
+#elif !defined(ss_NO_POOLS) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+#define ss_POOLS
+#define ss_LOCAL _Thread_local
+#endif
+
+#ifndef ss_POOL_LIMIT
+#define ss_POOL_LIMIT 1024
+#endif
+
+/* Map nodes with keys shorter than this share one pooled block size,
+   longer ones are allocated as they are. */
+#define POOL_KEY_SIZE 24
+
+enum {
+    POOL_MAP_NODE = TYPE_LAST,
+    POOL_LIST_NODE,
+    POOL_MAP_BUCKETS,
+    POOL_LAST
+};
+
+typedef struct {
+    void*  free;
+    size_t size;
+    size_t count;
+} ss_Pool;
+
+#ifdef ss_POOLS
+static ss_LOCAL ss_Pool      pools[POOL_LAST];
+static ss_LOCAL ss_PoolStats poolStats;
+#endif
+
+static void* poolTake( ss_Heap* heap, unsigned id, size_t sz ) {
+    #ifdef ss_POOLS
+        ss_Pool* pool = &pools[id];
+        if( heap->system && pool->free ) {
+            assert( pool->size == sz );
+            if( !heapCharge( heap, sizeof(ss_Block) + sz ) )
+                return NULL;
+            
+            ss_Block* blk = pool->free;
+            pool->free = *(void**)blk;
+            pool->count--;
+            poolStats.cached--;
+            poolStats.hits++;
+            blk->heap = heap;
+            blk->size = sz;
+            return blk + 1;
+        }
+        if( heap->system ) {
+            pool->size = sz;
+            poolStats.misses++;
+        }
+    #endif
+    return ss_malloc( heap, sz );
+}
+
+static void poolGive( unsigned id, void* ptr ) {
+    #ifdef ss_POOLS
+        ss_Block* blk  = (ss_Block*)ptr - 1;
+        ss_Heap*  heap = blk->heap;
+        ss_Pool*  pool = &pools[id];
+        if( heap->system && pool->count < ss_POOL_LIMIT ) {
+            heapRefund( heap, sizeof(ss_Block) + blk->size );
+            *(void**)blk = pool->free;
+            pool->free = blk;
+            pool->count++;
+            if( ++poolStats.cached > poolStats.peak )
+                poolStats.peak = poolStats.cached;
+            return;
+        }
+    #endif
+    ss_dealloc( ptr );
+}
+
+/* Patterns and contexts vary in size, and layout nodes live inside a
+   block of their own, so only the rest are pooled. */
+static bool pooled( ss_Type type ) {
+    return type != TYPE_PATTERN && type != TYPE_CONTEXT && type != TYPE_LAYOUT;
+}
+
+void ss_poolStats( ss_PoolStats* stats ) {
+    #ifdef ss_POOLS
+        *stats = poolStats;
+    #else
+        memset( stats, 0, sizeof(*stats) );
+    #endif
+}
+
+void ss_poolTrim( void ) {
+    #ifdef ss_POOLS
+        for( unsigned i = 0 ; i < POOL_LAST ; i++ ) {
+            while( pools[i].free ) {
+                void* ptr = pools[i].free;
+                pools[i].free = *(void**)ptr;
+                free( ptr );
+            }
+            pools[i].count = 0;
+        }
+        poolStats.cached = 0;
+    #endif
 }
 
-#define ss_obj( PTR ) ((void*)(PTR) - sizeof(ss_Object))
-static void* ss_alloc( size_t sz, ss_Type type ) {
-    ss_Object* obj = xmalloc( sizeof(ss_Object) + sz );
+#define ss_obj( PTR ) ((ss_Object*)((char*)(PTR) - sizeof(ss_Object)))
+static void* heapObject( ss_Heap* heap, size_t sz, ss_Type type ) {
+    ss_Object* obj;
+    if( pooled( type ) )
+        obj = poolTake( heap, type, sizeof(ss_Object) + sz );
+    else
+        obj = ss_malloc( heap, sizeof(ss_Object) + sz );
+    if( !obj )
+        return NULL;
     obj->type = type;
     obj->refc = 1;
     return obj->data;
 }
 
+static void* ss_alloc( ss_Context* ctx, size_t sz, ss_Type type ) {
+    return heapObject( ctx->heap, sz, type );
+}
+
 static void* ss_refer( void* ptr ) {
     ss_Object* obj = ss_obj( ptr );
     obj->refc++;
@@ -789,7 +2052,10 @@ static void* ss_refer( void* ptr ) {
 
 static void ss_free( void* ptr ) {
     ss_Object* obj = ss_obj( ptr );
-    free( obj );
+    if( pooled( obj->type ) )
+        poolGive( obj->type, obj );
+    else
+        ss_dealloc( obj );
 }
 
 static void freePattern( void* ptr );
@@ -800,7 +2066,9 @@ static void freeMap( void* ptr );
 static void freeList( void* ptr );
 static void freeBuffer( void* ptr );
 static void freeCompiler( void* ptr );
-static void freeIter( void* ptr );
+static void freeBinding( void* ptr );
+static void freeLayout( void* ptr );
+static void freeFeed( void* ptr );
 
 static void (*freeFuns[])( void* ptr ) = {
     freePattern,
@@ -811,7 +2079,9 @@ static void (*freeFuns[])( void* ptr ) = {
     freeList,
     freeBuffer,
     freeCompiler,
-    freeIter
+    freeBinding,
+    freeLayout,
+    freeFeed
 };
 
 void ss_release( void* ptr ) {
@@ -826,13 +2096,18 @@ void ss_release( void* ptr ) {
 
 typedef struct ss_MapNode ss_MapNode;
 
+/* Entries also remember the key pointer they were put with, which for
+   scopes is the binding string of the pattern that put them. */
 struct ss_MapNode {
     ss_MapNode* next;
     unsigned    hash;
+    char const* site;
     void*       value;
     char        key[];
 };
 
+/* Scopes are made for a lot of matches that never bind anything, so a
+   map's buckets aren't allocated until something is committed to it. */
 struct ss_Map {
     ss_MapNode** buf;
     unsigned     cnt;
@@ -841,29 +2116,57 @@ struct ss_Map {
     ss_MapNode* staged;
 };
 
-static ss_Map* ss_mapNew( void ) {
-    ss_Map* map = ss_alloc( sizeof(ss_Map), TYPE_MAP );
-    map->cap = 21;
+static ss_Map* ss_mapNew( ss_Context* ctx ) {
+    ss_Map* map = ss_alloc( ctx, sizeof(ss_Map), TYPE_MAP );
+    if( !map ) {
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        return NULL;
+    }
+    map->cap = 0;
     map->cnt = 0;
-    map->buf = xcalloc( map->cap, sizeof(ss_MapNode*) );
+    map->buf = NULL;
     map->staged = NULL;
     
     return map;
 }
 
-static unsigned hash( char const* key ) {
+static unsigned ss_mapHash( char const* key ) {
     unsigned h = 0;
     for( size_t i = 0 ; key[i] != '\0' ; i++ )
         h = h*37 + key[i];
     return h;
 }
 
-static void growMap( ss_Map* map, unsigned cap ) {
+/* Maps first get MAP_MIN_CAP buckets, and since most never grow past
+   that those are pooled. */
+#define MAP_MIN_CAP 21
+
+static void freeBuckets( ss_MapNode** buf, unsigned cap ) {
+    if( buf && cap == MAP_MIN_CAP )
+        poolGive( POOL_MAP_BUCKETS, buf );
+    else
+        ss_dealloc( buf );
+}
+
+static int growMap( ss_Context* ctx, ss_Map* map, unsigned cap ) {
     size_t       ocap = map->cap;
     ss_MapNode** obuf = map->buf;
+    ss_MapNode** nbuf;
+    if( cap == MAP_MIN_CAP ) {
+        nbuf = poolTake( ctx->heap, POOL_MAP_BUCKETS, sizeof(ss_MapNode*)*MAP_MIN_CAP );
+        if( nbuf )
+            memset( nbuf, 0, sizeof(ss_MapNode*)*MAP_MIN_CAP );
+    }
+    else {
+        nbuf = ss_calloc( ctx->heap, cap, sizeof(ss_MapNode*) );
+    }
+    if( !nbuf ) {
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        return -1;
+    }
     
     map->cap = cap;
-    map->buf = xcalloc( map->cap, sizeof(ss_MapNode*) );
+    map->buf = nbuf;
     
     for( unsigned i = 0 ; i < ocap ; i++ ) {
         ss_MapNode* it = obuf[i];
@@ -877,24 +2180,52 @@ static void growMap( ss_Map* map, unsigned cap ) {
         }
     }
     
-    free( obuf );
+    freeBuckets( obuf, ocap );
+    return 0;
+}
+
+static int ss_mapPut( ss_Context* ctx, ss_Map* map, char const* key, void* val ) {
+    return ss_mapPutSite( ctx, map, key, key, val );
 }
 
-static void ss_mapPut( ss_Map* map, char const* key, void* val ) {
-    unsigned h = hash( key );
+/* Puts `val` under a copy of `key`, remembering `site` as where it was
+   bound for ss_mapSite() to look for. */
+static int ss_mapPutSite( ss_Context* ctx, ss_Map* map, char const* key, char const* site, void* val ) {
+    unsigned h = ss_mapHash( key );
 
     size_t keyLen = strlen( key );
-    ss_MapNode* node = xmalloc( sizeof(ss_MapNode) + keyLen + 1 );
+    ss_MapNode* node;
+    if( keyLen < POOL_KEY_SIZE )
+        node = poolTake( ctx->heap, POOL_MAP_NODE, sizeof(ss_MapNode) + POOL_KEY_SIZE );
+    else
+        node = ss_malloc( ctx->heap, sizeof(ss_MapNode) + keyLen + 1 );
+    if( !node ) {
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        return -1;
+    }
     node->next  = map->staged;
     node->hash  = h;
+    node->site  = site;
     node->value = ss_refer( val );
     strcpy( node->key, key );
     
     map->staged = node;
+    return 0;
+}
+
+static void freeMapNode( ss_MapNode* node ) {
+    ss_release( node->value );
+    if( strlen( node->key ) < POOL_KEY_SIZE )
+        poolGive( POOL_MAP_NODE, node );
+    else
+        ss_dealloc( node );
 }
 
-static void* ss_mapGet( ss_Map* map, char const* key ) {
-    unsigned h = hash( key );
+static void* ss_mapGet( ss_Context* ctx, ss_Map* map, char const* key ) {
+    if( map->cap == 0 )
+        return NULL;
+    
+    unsigned h = ss_mapHash( key );
     unsigned i = h % map->cap;
     
     ss_MapNode* it = map->buf[i];
@@ -907,12 +2238,41 @@ static void* ss_mapGet( ss_Map* map, char const* key ) {
     return NULL;
 }
 
-static void ss_mapCommit( ss_Map* map ) {
+/* Finds an entry put with one of the given key pointers, so without
+   hashing or comparing the key itself. */
+static void* ss_mapSite( ss_Context* ctx, ss_Map* map, unsigned hash, char const** sites, size_t count ) {
+    if( map->cap == 0 )
+        return NULL;
+    
+    for( ss_MapNode* it = map->buf[hash % map->cap] ; it ; it = it->next ) {
+        if( it->hash != hash )
+            continue;
+        for( size_t i = 0 ; i < count ; i++ ) {
+            if( it->site == sites[i] )
+                return it->value;
+        }
+    }
+    return NULL;
+}
+
+static int ss_mapCommit( ss_Context* ctx, ss_Map* map ) {
+    if( !map->staged )
+        return 0;
+    
+    unsigned cnt = map->cnt;
     for( ss_MapNode* it = map->staged ; it ; it = it->next )
-        map->cnt++;
+        cnt++;
     
-    if( map->cnt*3 > map->cap )
-        growMap( map, map->cnt*3 );
+    if( map->cap == 0 ) {
+        if( growMap( ctx, map, cnt*3 > MAP_MIN_CAP ? cnt*3 : MAP_MIN_CAP ) )
+            return -1;
+    }
+    else
+    if( cnt*3 > map->cap ) {
+        if( growMap( ctx, map, cnt*3 ) )
+            return -1;
+    }
+    map->cnt = cnt;
 
     ss_MapNode* it = map->staged;
     while( it ) {
@@ -925,16 +2285,16 @@ static void ss_mapCommit( ss_Map* map ) {
     }
     
     map->staged = NULL;
+    return 0;
 }
 
-static void ss_mapCancel( ss_Map* map ) {
+static void ss_mapCancel( ss_Context* ctx, ss_Map* map ) {
     ss_MapNode* it = map->staged;
     while( it ) {
         ss_MapNode* node = it;
         it = node->next;
         
-        ss_release( node->value );
-        free( node );
+        freeMapNode( node );
     }
     
     map->staged = NULL;
@@ -943,7 +2303,7 @@ static void ss_mapCancel( ss_Map* map ) {
 static void freeMap( void* ptr ) {
     ss_Map* map = ptr;
     
-    ss_mapCancel( map );
+    ss_mapCancel( NULL, map );
     
     for( unsigned i = 0 ; i < map->cap ; i++ ) {
         ss_MapNode* it = map->buf[i];
@@ -951,12 +2311,11 @@ static void freeMap( void* ptr ) {
             ss_MapNode* node = it;
             it = it->next;
             
-            ss_release( node->value );
-            free( node );
+            freeMapNode( node );
         }
     }
     
-    free( map->buf );
+    freeBuckets( map->buf, map->cap );
     ss_free( map );
 }
 
@@ -974,15 +2333,23 @@ struct ss_List {
     ss_ListNode* last;
 };
 
-static ss_List* ss_listNew( void ) {
-    ss_List* list = ss_alloc( sizeof(ss_List), TYPE_LIST );
+static ss_List* ss_listNew( ss_Context* ctx ) {
+    ss_List* list = ss_alloc( ctx, sizeof(ss_List), TYPE_LIST );
+    if( !list ) {
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        return NULL;
+    }
     list->first  = NULL;
     list->last   = NULL;
     return list;
 }
 
-static void ss_listAdd( ss_List* list, void* val ) {
-    ss_ListNode* node = xmalloc( sizeof(ss_ListNode) );
+static int ss_listAdd( ss_Context* ctx, ss_List* list, void* val ) {
+    ss_ListNode* node = poolTake( ctx->heap, POOL_LIST_NODE, sizeof(ss_ListNode) );
+    if( !node ) {
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        return -1;
+    }
     node->value = ss_refer( val );
     node->next  = NULL;
     
@@ -994,27 +2361,7 @@ static void ss_listAdd( ss_List* list, void* val ) {
         list->first  = node;
         list->last   = node;
     }
-}
-
-struct ss_Iter {
-    ss_List*     list;
-    ss_ListNode* next;
-};
-
-static ss_Iter* ss_listIter( ss_List* list ) {
-    ss_Iter* iter = ss_alloc( sizeof(ss_Iter), TYPE_ITER );
-    iter->list = ss_refer( list );
-    iter->next = list->first;
-    return iter;
-}
-
-static void* ss_iterNext( ss_Iter* iter ) {
-    if( !iter->next )
-        return NULL;
-    ss_ListNode* node = iter->next;
-    iter->next = node->next;
-    
-    return node->value;
+    return 0;
 }
 
 static void freeList( void* dat ) {
@@ -1026,18 +2373,12 @@ static void freeList( void* dat ) {
         it = it->next;
         
         ss_release( node->value );
-        free( node );
+        poolGive( POOL_LIST_NODE, node );
     }
     
     ss_free( list );
 }
 
-static void freeIter( void* dat ) {
-    ss_Iter* iter = dat;
-    ss_release( iter->list );
-    ss_free( iter );
-}
-
 /**************************** Buffer Implementation ***************************/
 
 struct ss_Buffer {
@@ -1046,679 +2387,4080 @@ struct ss_Buffer {
     long*  buf;
 };
 
-static ss_Buffer* ss_bufferNew( void ) {
-    ss_Buffer* buf = ss_alloc( sizeof(ss_Buffer), TYPE_BUFFER );
+static ss_Buffer* ss_bufferNew( ss_Context* ctx ) {
+    ss_Buffer* buf = ss_alloc( ctx, sizeof(ss_Buffer), TYPE_BUFFER );
+    if( !buf ) {
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        return NULL;
+    }
     buf->cap = 16;
     buf->top = 0;
-    buf->buf = xmalloc( sizeof(long)*buf->cap );
+    buf->buf = ss_malloc( ctx->heap, sizeof(long)*buf->cap );
+    if( !buf->buf ) {
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        ss_release( buf );
+        return NULL;
+    }
     return buf;
 }
 
-static void ss_bufferPut( ss_Buffer* buf, long ch ) {
+static int ss_bufferPut( ss_Context* ctx, ss_Buffer* buf, long ch ) {
     if( buf->top >= buf->cap ) {
+        long* nbuf = ss_realloc( ctx->heap, buf->buf, sizeof(long)*buf->cap*2 );
+        if( !nbuf ) {
+            ss_error( ctx, ss_ERR_ALLOC, NULL );
+            return -1;
+        }
+        buf->buf  = nbuf;
         buf->cap *= 2;
-        buf->buf = xrealloc( buf->buf, sizeof(long)*buf->cap );
     }
     buf->buf[buf->top++] = ch;
+    return 0;
 }
 
-static size_t ss_bufferLen( ss_Buffer* buf ) {
+static size_t ss_bufferLen( ss_Context* ctx, ss_Buffer* buf ) {
     return buf->top;
 }
 
-static long const* ss_bufferBuf( ss_Buffer* buf ) {
+static long const* ss_bufferBuf( ss_Context* ctx, ss_Buffer* buf ) {
     return buf->buf;
 }
 
 static void freeBuffer( void* ptr ) {
     ss_Buffer* buf = ptr;
-    free( buf->buf );
+    ss_dealloc( buf->buf );
     ss_free( buf );
 }
 
 
-/**************************** Primitive Patterns ******************************/
-static void freePattern( void* ptr ) {
-    ss_Pattern* pat = ptr;
-    if( pat->clean )
-        pat->clean( pat );
-    if( pat->binding )
-        free( pat->binding );
-    ss_free( pat );
-}
+/****************************** Resumable Matching ****************************/
 
-static void freeMatch( void* ptr ) {
-    ss_Match* match = ptr;
-    if( match->scope )
-        ss_release( match->scope );
-    if( match->next )
-        ss_release( match->next );
-    ss_free( match );
+/* How much room a scanner over a reader makes for each read. */
+#define ss_READ_SIZE 65536
+
+/* True while a feed has frames left to take back. */
+#define ss_resuming( CTX ) ( (CTX)->feed && (CTX)->feed->saved.count )
+
+static void framesDrop( ss_Frames* frames ) {
+    frames->count = 0;
 }
 
-typedef struct {
-    ss_Pattern pat;
-    ss_List*   patterns;
-} AllOfPattern;
+/* Takes the frame on top of the saved ones if it's for this matcher. */
+static ss_Frame const* feedResume( ss_Context* ctx, ss_FrameKind kind, ss_Pattern* pat, char const* loc ) {
+    ss_Frames* saved = &ctx->feed->saved;
+    ss_Frame*  frame = &saved->frames[saved->count - 1];
+    if( frame->kind != kind || frame->pat != pat || frame->loc != loc )
+        return NULL;
+    saved->count--;
+    return frame;
+}
 
-static ss_Match* allOfMatcher( ss_Pattern* p, ss_Map* scope, ss_Stream* stream ) {
-    AllOfPattern* allOfPat = (AllOfPattern*)p;
-    
-    char const* loc = stream->loc;
-    
-    ss_Iter*    it  = ss_listIter( allOfPat->patterns );
-    ss_Pattern* nxt = ss_iterNext( it );
-    ss_Match*   sub = NULL;
-    while( nxt ) {
-        sub = nxt->match( nxt, scope, stream );
-        if( !sub ) {
-            ss_release( it );
-            return NULL;
+/* Saves a frame.  If there's no room for it the allocation failure
+   fails the match. */
+static void feedSuspend( ss_Context* ctx, ss_Frame const* frame ) {
+    ss_Frames* next = &ctx->feed->next;
+    if( next->count == next->cap ) {
+        size_t    cap    = next->cap ? next->cap*2 : 16;
+        ss_Frame* frames = ss_realloc( ctx->heap, next->frames, sizeof(ss_Frame)*cap );
+        if( !frames ) {
+            ss_error( ctx, ss_ERR_ALLOC, NULL );
+            return;
         }
-        ss_release( sub );
-        nxt = ss_iterNext( it );
+        next->frames = frames;
+        next->cap    = cap;
     }
-    ss_release( it );
-    char const* end = stream->loc;
-    
-    ss_Match* mat = ss_alloc( sizeof(ss_Match), TYPE_MATCH );
-    mat->scope = ss_refer( scope );
-    mat->next  = NULL;
-    mat->loc   = loc;
-    mat->end   = end;
-    return mat;
+    next->frames[next->count++] = *frame;
 }
 
-static void allOfCleaner( ss_Pattern* pat ) {
-    AllOfPattern* allOfPat = (AllOfPattern*)pat;
-    ss_release( allOfPat->patterns );
+/* Moving the buffer moves the input that saved frames and the matches
+   logged so far point into. */
+static void rebase( char const** ptr, char const* from, size_t len, char const* to ) {
+    uintptr_t at = (uintptr_t)*ptr;
+    if( *ptr && at >= (uintptr_t)from && at <= (uintptr_t)from + len )
+        *ptr = to + ( at - (uintptr_t)from );
 }
 
-static ss_Pattern* ss_allOfPattern( ss_List* patterns ) {
-    AllOfPattern* allOfPat = ss_alloc( sizeof(AllOfPattern), TYPE_PATTERN );
-    allOfPat->pat.match   = allOfMatcher;
-    allOfPat->pat.clean   = allOfCleaner;
-    allOfPat->pat.binding = NULL;
-    allOfPat->patterns    = ss_refer( patterns );
-    return (ss_Pattern*)allOfPat;
+static void feedRebase( ss_Feed* feed, char const* from, size_t len, char const* to ) {
+    for( size_t i = 0 ; i < feed->saved.count ; i++ ) {
+        ss_Frame* frame = &feed->saved.frames[i];
+        rebase( &frame->loc, from, len, to );
+        rebase( &frame->at, from, len, to );
+    }
+    for( size_t i = 0 ; i < feed->log.count ; i++ ) {
+        ss_Capture* cap = &feed->log.caps[i];
+        rebase( &cap->loc, from, len, to );
+        rebase( &cap->end, from, len, to );
+    }
 }
 
-
-typedef struct {
-    ss_Pattern pat;
-    ss_List*   patterns;
-} OneOfPattern;
-
-static ss_Match* oneOfMatcher( ss_Pattern* p, ss_Map* scope, ss_Stream* stream ) {
-    OneOfPattern* oneOfPat = (OneOfPattern*)p;
+/* Makes room for `extra` more bytes of input after dropping the first
+   `drop` bytes of the buffer.  While frames are saved what's kept moves
+   to a new buffer so they can be rebased onto it. */
+static int feedReserve( ss_Context* ctx, ss_Feed* feed, size_t drop, size_t extra ) {
+    size_t keep = feed->len - drop;
+    if( drop == 0 && extra <= feed->cap - feed->len )
+        return 0;
+    if( !feed->saved.count && extra <= feed->cap - keep ) {
+        memmove( feed->buf, feed->buf + drop, keep );
+        feed->len = keep;
+        return 0;
+    }
     
-    ss_Iter*    it  = ss_listIter( oneOfPat->patterns );
-    ss_Pattern* nxt = ss_iterNext( it );
-    ss_Match*   sub = NULL;
-    while( nxt ) {
-        ss_Stream saved = *stream;
-        
-        sub = nxt->match( nxt, scope, stream );
-        if( sub ) {
-            ss_release( it );
-            return sub;
+    size_t cap = feed->cap ? feed->cap : 256;
+    while( cap - keep < extra ) {
+        if( cap > SIZE_MAX/2 ) {
+            ss_error( ctx, ss_ERR_ALLOC, NULL );
+            return -1;
         }
-        *stream = saved;
-        ss_mapCancel( scope );
-        nxt = ss_iterNext( it );
+        cap *= 2;
     }
-    ss_release( it );
-    return NULL;
+    
+    char* buf = ss_malloc( ctx->heap, cap );
+    if( !buf ) {
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        return -1;
+    }
+    if( keep )
+        memcpy( buf, feed->buf + drop, keep );
+    feedRebase( feed, feed->buf + drop, keep, buf );
+    ss_dealloc( feed->buf );
+    feed->buf = buf;
+    feed->cap = cap;
+    feed->len = keep;
+    return 0;
 }
 
-static void oneOfCleaner( ss_Pattern* p ) {
-    OneOfPattern* oneOfPat = (OneOfPattern*)p;
-    ss_release( oneOfPat->patterns );
+static int feedAppend( ss_Context* ctx, ss_Feed* feed, char const* str, size_t len ) {
+    if( feedReserve( ctx, feed, 0, len ) )
+        return -1;
+    if( len )
+        memcpy( feed->buf + feed->len, str, len );
+    feed->len += len;
+    return 0;
 }
 
-static ss_Pattern* ss_oneOfPattern( ss_List* patterns ) {
-    OneOfPattern* oneOfPat = ss_alloc( sizeof(OneOfPattern), TYPE_PATTERN );
-    oneOfPat->pat.match   = oneOfMatcher;
-    oneOfPat->pat.clean   = oneOfCleaner;
-    oneOfPat->pat.binding = NULL;
-    oneOfPat->patterns    = ss_refer( patterns );
-    return (ss_Pattern*)oneOfPat;
+/* Replaces what's in the buffer with a copy of `len` bytes at `str`,
+   moving the saved frames that point into them onto the copy. */
+static int feedAdopt( ss_Context* ctx, ss_Feed* feed, char const* str, size_t len ) {
+    feed->len = 0;
+    if( feedReserve( ctx, feed, 0, len ) )
+        return -1;
+    if( len )
+        memcpy( feed->buf, str, len );
+    feedRebase( feed, str, len, feed->buf );
+    feed->len = len;
+    return 0;
 }
 
-
-typedef struct {
-    ss_Pattern  pat;
-    ss_Pattern* wrapped;
-} HasNextPattern;
-
-static ss_Match* hasNextMatcher( ss_Pattern* p, ss_Map* scope, ss_Stream* stream ) {
-    HasNextPattern* hasNextPat = (HasNextPattern*)p;
+/* Matches the pattern against the input from `loc` to `end`, picking
+   up from the saved frames if there are any.  The feed's log stands in
+   for the context's while it matches.  A starved attempt leaves
+   `ctx->starved` set and keeps the frames it saved and what it logged,
+   anything else drops them.  The caller arms the limits and checks for
+   failures. */
+static ss_Match* feedAttempt( ss_Context* ctx, ss_Feed* feed, char const* loc, char const* end, bool open ) {
+    ss_Filter const* filter = feed->pat->filter ? &feed->pat->filter[feed->fmt] : NULL;
     
-    ss_Stream saved = *stream;
-    ss_Pattern* pat = hasNextPat->wrapped;
-    ss_Match*   match = pat->match( pat, scope, stream );
+    ss_Stream stream = ss_makeStream( feed->fmt, loc, end );
+    stream.open = open;
     
-    *stream = saved;
+    ss_Log log = ctx->log;
+    ctx->log  = feed->log;
+    if( !feed->saved.count ) {
+        ctx->log.count  = 0;
+        ctx->log.scopes = 0;
+    }
+    ctx->feed = feed;
+    ss_Match* match = scopedMatch( ctx, feed->pat, !filter || filter->scoped, &stream );
+    ctx->feed = NULL;
     
+    ss_Frames saved = feed->saved;
+    framesDrop( &saved );
+    feed->saved = feed->next;
+    feed->next  = saved;
+    
+    if( ctx->starved ) {
+        if( match )
+            ss_release( match );
+        feed->log = ctx->log;
+        ctx->log  = log;
+        return NULL;
+    }
+    framesDrop( &feed->saved );
+    if( match )
+        match = matchResult( ctx, match );
+    ctx->log.count = 0;
+    feed->log = ctx->log;
+    ctx->log  = log;
     return match;
 }
 
-static void hasNextCleaner( ss_Pattern* p ) {
-    HasNextPattern* hasNextPat = (HasNextPattern*)p;
-    ss_release( hasNextPat->wrapped );
+/* Matches the pattern against the start of everything fed so far.
+   Once a match is decided the feed keeps the result. */
+static ss_Match* feedRun( ss_Context* ctx, ss_Feed* feed ) {
+    size_t failed = ctx->heap->failed;
+    ctx->starved  = false;
+    ss_arm( ctx );
+    ss_Match* match = feedAttempt( ctx, feed, feed->buf, feed->buf + feed->len, !feed->ended );
+    
+    if( ctx->heap->failed != failed ) {
+        ctx->starved = false;
+        framesDrop( &feed->saved );
+        return ss_failed( ctx, match );
+    }
+    if( ctx->starved ) {
+        ctx->starved = false;
+        ss_error( ctx, ss_ERR_MORE, NULL );
+        return NULL;
+    }
+    if( ctx->halted )
+        return ss_stopped( ctx, match );
+    
+    feed->decided = true;
+    feed->match   = match;
+    return match ? ss_refer( match ) : NULL;
 }
 
-static ss_Pattern* ss_hasNextPattern( ss_Pattern* pattern ) {
-    HasNextPattern* hasNextPat = ss_alloc( sizeof(HasNextPattern), TYPE_PATTERN );
-    hasNextPat->pat.match   = hasNextMatcher;
-    hasNextPat->pat.clean   = hasNextCleaner;
-    hasNextPat->pat.binding = NULL;
-    hasNextPat->wrapped     = ss_refer( pattern );
-    return (ss_Pattern*)hasNextPat;
+/* Starts matching a pattern against input that arrives in pieces, such
+   as messages read from a non-blocking socket.  Each piece is given to
+   ss_feedMore(), which fails with ss_ERR_MORE until there's enough of
+   the input to decide whether it starts with a match, and ss_feedEnd()
+   says there's no more to come.  Work done on earlier pieces is kept,
+   down to the part of a sequence, alternative or copy of a repetition
+   that ran out, so matching picks up there rather than starting over.
+   Matches point into the feed's own copy of the input. */
+ss_Feed* ss_feed( ss_Context* ctx, ss_Pattern* pat, ss_Format fmt ) {
+    ss_Feed* feed = ss_alloc( ctx, sizeof(ss_Feed), TYPE_FEED );
+    if( !feed ) {
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        return NULL;
+    }
+    feed->pat     = ss_refer( pat );
+    feed->fmt     = fmt;
+    feed->buf     = NULL;
+    feed->len     = 0;
+    feed->cap     = 0;
+    feed->ended   = false;
+    feed->decided = false;
+    feed->match   = NULL;
+    feed->saved   = (ss_Frames){ 0 };
+    feed->next    = (ss_Frames){ 0 };
+    feed->log     = (ss_Log){ 0 };
+    return feed;
+}
+
+ss_Match* ss_feedMore( ss_Context* ctx, ss_Feed* feed, char const* str, size_t len ) {
+    if( feed->decided )
+        return feed->match ? ss_refer( feed->match ) : NULL;
+    if( feedAppend( ctx, feed, str, len ) )
+        return NULL;
+    return feedRun( ctx, feed );
 }
 
+ss_Match* ss_feedEnd( ss_Context* ctx, ss_Feed* feed ) {
+    if( feed->decided )
+        return feed->match ? ss_refer( feed->match ) : NULL;
+    feed->ended = true;
+    return feedRun( ctx, feed );
+}
 
-typedef struct {
-    ss_Pattern  pat;
-    ss_Pattern* wrapped;
-} NotNextPattern;
+static void freeFeed( void* ptr ) {
+    ss_Feed* feed = ptr;
+    framesDrop( &feed->saved );
+    framesDrop( &feed->next );
+    ss_dealloc( feed->saved.frames );
+    ss_dealloc( feed->next.frames );
+    ss_dealloc( feed->log.caps );
+    if( feed->match )
+        ss_release( feed->match );
+    ss_release( feed->pat );
+    ss_dealloc( feed->buf );
+    ss_free( feed );
+}
 
-static ss_Match* notNextMatcher( ss_Pattern* p, ss_Map* scope, ss_Stream* stream ) {
-    NotNextPattern* notNextPat = (NotNextPattern*)p;
+/* Reads more of a reader's input onto the end of the window.  Once the
+   next attempt starts at least half way in, what's before it is dropped
+   first, so the window only grows to fit the longest match in progress
+   and each byte is moved about once.  Returns -1 if there's no room. */
+static int readerFill( ss_Context* ctx, ss_Scanner* scanner, bool compact ) {
+    ss_Feed* feed = scanner->feed;
+    size_t   drop = 0;
+    if( compact && ( scanner->at >= feed->len/2 || ss_READ_SIZE > feed->cap - feed->len ) )
+        drop = scanner->at;
+    if( feedReserve( ctx, feed, drop, ss_READ_SIZE ) )
+        return -1;
+    scanner->base += drop;
+    scanner->at   -= drop;
+    
+    size_t got = scanner->read( scanner->data, feed->buf + feed->len, feed->cap - feed->len );
+    if( got == 0 )
+        scanner->eof = true;
+    feed->len += got;
+    return 0;
+}
+
+/* Steps the window past the symbol at the start of the next attempt,
+   reading more if it's cut short but leaving the window where it is. */
+static int readerStep( ss_Context* ctx, ss_Scanner* scanner ) {
+    ss_Feed* feed = scanner->feed;
+    for( ;; ) {
+        ss_Stream stream = ss_makeStream( feed->fmt, feed->buf + scanner->at, feed->buf + feed->len );
+        stream.open = !scanner->eof;
+        stream.read( ctx, &stream );
+        if( !ctx->starved ) {
+            scanner->at = (size_t)( stream.loc - feed->buf );
+            return 0;
+        }
+        ss_unstarve( ctx );
+        if( readerFill( ctx, scanner, false ) )
+            return -1;
+    }
+}
+
+/* Scans a reader's input the way ss_find() scans a text.  The filter
+   leaves the last few bytes of the window alone since it can't see what
+   follows them, and it can only rule out the rest of the input once
+   that's all been read.  An attempt that runs out of window is picked
+   up again once more has been read. */
+static ss_Match* readerFind( ss_Context* ctx, ss_Scanner* scanner ) {
+    ss_Feed*         feed   = scanner->feed;
+    ss_Filter const* filter = scanner->filter;
+    size_t           failed = ctx->heap->failed;
+    ctx->starved = false;
+    ss_arm( ctx );
+    for( ;; ) {
+        if( scanner->at == feed->len ) {
+            if( scanner->eof )
+                return NULL;
+            if( readerFill( ctx, scanner, true ) )
+                return NULL;
+            continue;
+        }
+        
+        if( filter ) {
+            char const* loc = feed->buf + scanner->at;
+            char const* end = feed->buf + feed->len;
+            if( scanner->eof && (size_t)( end - loc ) < filter->shortest ) {
+                scanner->at = feed->len;
+                return NULL;
+            }
+            char const* to = filterSkip( filter, loc, end );
+            if( to == end && !scanner->eof ) {
+                size_t unseen = filter->teddy ? filter->teddy - 1 : 0;
+                scanner->at = (size_t)( end - loc ) > unseen ? feed->len - unseen : scanner->at;
+                if( readerFill( ctx, scanner, true ) )
+                    return NULL;
+                continue;
+            }
+            scanner->at = (size_t)( to - feed->buf );
+            if( to == end )
+                continue;
+        }
+        
+        ss_Match* m = feedAttempt( ctx, feed, feed->buf + scanner->at, feed->buf + feed->len, !scanner->eof );
+        while( ctx->starved ) {
+            ss_unstarve( ctx );
+            if( readerFill( ctx, scanner, true ) ) {
+                framesDrop( &feed->saved );
+                return NULL;
+            }
+            m = feedAttempt( ctx, feed, feed->buf + scanner->at, feed->buf + feed->len, !scanner->eof );
+        }
+        if( ctx->heap->failed != failed )
+            return ss_failed( ctx, m );
+        if( ctx->halted )
+            return ss_stopped( ctx, m );
+        
+        if( m && m->end > m->loc ) {
+            scanner->at = (size_t)( m->end - feed->buf );
+            return m;
+        }
+        if( readerStep( ctx, scanner ) ) {
+            if( m )
+                ss_release( m );
+            return NULL;
+        }
+        if( m )
+            return m;
+    }
+}
+
+/* Starts scanning input that's read a buffer at a time, such as a file
+   or socket too large to hold at once.  Input before the next attempt is
+   let go of as the scan moves on, so the memory used depends on the
+   longest match rather than the length of the input.  The reader fills
+   up to `cap` bytes of `buf` and returns how many it filled, zero once
+   the input has ended.  Matches found by ss_find() point into the
+   scanner's window and are only good until the next call, with
+   ss_position() giving where they are in the input. */
+ss_Scanner* ss_startReader( ss_Context* ctx, ss_Pattern* pat, ss_Format fmt, ss_Reader read, void* data ) {
+    ss_Scanner* scanner = ss_alloc( ctx, sizeof(ss_Scanner), TYPE_SCANNER );
+    if( !scanner ) {
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        return NULL;
+    }
+    scanner->pat       = ss_refer( pat );
+    scanner->filter    = pat->filter ? &pat->filter[fmt] : NULL;
+    scanner->need      = NULL;
+    scanner->stream    = ss_makeStream( fmt, NULL, NULL );
+    scanner->str       = NULL;
+    scanner->read      = read;
+    scanner->data      = data;
+    scanner->base      = 0;
+    scanner->at        = 0;
+    scanner->eof       = false;
+    scanner->slices    = NULL;
+    scanner->count     = 0;
+    scanner->slice     = 0;
+    scanner->sliceBase = 0;
+    scanner->total     = 0;
+    scanner->feed      = ss_feed( ctx, pat, fmt );
+    if( !scanner->feed ) {
+        ss_release( scanner );
+        return NULL;
+    }
+    return scanner;
+}
+
+/* Moves the next attempt of a scanner over slices to `pos` bytes into
+   its input, past the end of any slice it's reached. */
+static void slicesSeek( ss_Scanner* scanner, uint64_t pos ) {
+    if( pos > scanner->total )
+        pos = scanner->total;
+    while( scanner->slice + 1 < scanner->count && pos >= scanner->sliceBase + scanner->slices[scanner->slice].len ) {
+        scanner->sliceBase += scanner->slices[scanner->slice].len;
+        scanner->slice++;
+    }
+    scanner->at = (size_t)( pos - scanner->sliceBase );
+}
+
+/* Attempts a match in place in the current slice.  One that reaches the
+   end of the slice moves what it's matched so far into the feed's
+   buffer, which then takes as much of the slices after as it needs, a
+   piece at a time. */
+static ss_Match* slicesAttempt( ss_Context* ctx, ss_Scanner* scanner ) {
+    ss_Feed*        feed  = scanner->feed;
+    ss_Slice const* slice = &scanner->slices[scanner->slice];
+    uint64_t        start = scanner->sliceBase + scanner->at;
+    size_t          next  = scanner->slice + 1;
+    size_t          taken = 0;
+    
+    scanner->str  = slice->str;
+    scanner->base = scanner->sliceBase;
+    ss_Match* m = feedAttempt( ctx, feed, slice->str + scanner->at, slice->str + slice->len, scanner->sliceBase + slice->len < scanner->total );
+    if( !ctx->starved )
+        return m;
+    
+    ss_unstarve( ctx );
+    if( feedAdopt( ctx, feed, slice->str + scanner->at, slice->len - scanner->at ) ) {
+        framesDrop( &feed->saved );
+        return NULL;
+    }
+    for( ;; ) {
+        for( size_t room = ss_READ_SIZE ; room && next < scanner->count ; ) {
+            ss_Slice const* from = &scanner->slices[next];
+            size_t          len  = from->len - taken < room ? from->len - taken : room;
+            if( feedAppend( ctx, feed, from->str + taken, len ) ) {
+                framesDrop( &feed->saved );
+                return NULL;
+            }
+            room  -= len;
+            taken += len;
+            if( taken == from->len ) {
+                next++;
+                taken = 0;
+            }
+        }
+        m = feedAttempt( ctx, feed, feed->buf, feed->buf + feed->len, next < scanner->count );
+        if( !ctx->starved )
+            break;
+        ss_unstarve( ctx );
+    }
+    
+    scanner->str  = feed->buf;
+    scanner->base = start;
+    return m;
+}
+
+/* Scans slices the way ss_find() scans a text.  The filter runs over
+   each slice on its own, so the last few bytes of a slice it can't see
+   past are attempted without it. */
+static ss_Match* slicesFind( ss_Context* ctx, ss_Scanner* scanner ) {
+    ss_Filter const* filter = scanner->filter;
+    ss_Format        fmt    = scanner->feed->fmt;
+    size_t           failed = ctx->heap->failed;
+    ctx->starved = false;
+    ss_arm( ctx );
+    for( ;; ) {
+        slicesSeek( scanner, scanner->sliceBase + scanner->at );
+        ss_Slice const* slice = &scanner->slices[scanner->slice];
+        uint64_t        pos   = scanner->sliceBase + scanner->at;
+        if( pos == scanner->total )
+            return NULL;
+        
+        char const* loc = slice->str + scanner->at;
+        char const* end = slice->str + slice->len;
+        if( filter ) {
+            if( scanner->total - pos < filter->shortest ) {
+                slicesSeek( scanner, scanner->total );
+                return NULL;
+            }
+            char const* to = filterSkip( filter, loc, end );
+            if( to == end ) {
+                size_t unseen = filter->teddy && scanner->slice + 1 < scanner->count ? filter->teddy - 1 : 0;
+                if( (size_t)( end - loc ) > unseen || ( fmt == ss_CHARS && isAfterChr( *loc ) ) ) {
+                    scanner->at = (size_t)( end - loc ) > unseen ? slice->len - unseen : scanner->at + 1;
+                    continue;
+                }
+                to = loc;
+            }
+            scanner->at = (size_t)( to - slice->str );
+            pos = scanner->sliceBase + scanner->at;
+            loc = to;
+        }
+        
+        ss_Match* m = slicesAttempt( ctx, scanner );
+        if( ctx->heap->failed != failed )
+            return ss_failed( ctx, m );
+        if( ctx->halted )
+            return ss_stopped( ctx, m );
+        
+        if( m && m->end > m->loc )
+            slicesSeek( scanner, scanner->base + (uint64_t)( m->end - scanner->str ) );
+        else
+            slicesSeek( scanner, pos + symbolSize( fmt, *loc ) );
+        if( m )
+            return m;
+    }
+}
+
+/* Starts scanning input held in pieces, such as a ring buffer or a rope,
+   without first copying it into one piece.  Each slice is matched where
+   it is, and a match that runs across the end of one is finished in a
+   copy of just the input it covers.  Matches found by ss_find() point
+   either into a slice or into the scanner's copy, which is only good
+   until the next call, and ss_position() gives where they are in the
+   whole input.  The slices must outlive the scanner and all be in the
+   same format. */
+ss_Scanner* ss_startSlices( ss_Context* ctx, ss_Pattern* pat, ss_Slice const* slices, size_t count ) {
+    ss_Format   fmt     = count ? slices[0].fmt : ss_BYTES;
+    ss_Scanner* scanner = ss_alloc( ctx, sizeof(ss_Scanner), TYPE_SCANNER );
+    if( !scanner ) {
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        return NULL;
+    }
+    scanner->pat       = ss_refer( pat );
+    scanner->filter    = pat->filter ? &pat->filter[fmt] : NULL;
+    scanner->need      = NULL;
+    scanner->stream    = ss_makeStream( fmt, NULL, NULL );
+    scanner->str       = count ? slices[0].str : NULL;
+    scanner->read      = NULL;
+    scanner->data      = NULL;
+    scanner->base      = 0;
+    scanner->at        = 0;
+    scanner->eof       = true;
+    scanner->slices    = count ? slices : NULL;
+    scanner->count     = count;
+    scanner->slice     = 0;
+    scanner->sliceBase = 0;
+    scanner->total     = 0;
+    for( size_t i = 0 ; i < count ; i++ )
+        scanner->total += slices[i].len;
+    scanner->feed      = ss_feed( ctx, pat, fmt );
+    if( !scanner->feed ) {
+        ss_release( scanner );
+        return NULL;
+    }
+    return scanner;
+}
+
+/* Points a scanner made by ss_startReader() back at the start of its
+   reader's input, keeping the window's buffer for reuse. */
+static void readerRewind( ss_Scanner* scanner ) {
+    framesDrop( &scanner->feed->saved );
+    scanner->feed->len = 0;
+    scanner->base      = 0;
+    scanner->at        = 0;
+    scanner->eof       = false;
+}
+
+/* The offset into a scanner's whole input of a location in one of its
+   matches. */
+uint64_t ss_position( ss_Context* ctx, ss_Scanner* scanner, char const* loc ) {
+    char const* origin = scanner->read ? scanner->feed->buf : scanner->str;
+    return scanner->base + (uint64_t)( loc - origin );
+}
+
+/******************************** Span Kernels ********************************/
+
+static char const* spanScalar( ss_ByteSet const* set, char const* loc, char const* end ) {
+    while( loc < end && ss_bitGet( set->bits, (unsigned char)*loc ) )
+        loc++;
+    return loc;
+}
+
+#ifdef ss_X86
+__attribute__((target("sse2")))
+static char const* spanSSE2( ss_ByteSet const* set, char const* loc, char const* end ) {
+    __m128i lo[SPAN_RANGES];
+    __m128i ln[SPAN_RANGES];
+    for( unsigned i = 0 ; i < set->nranges ; i++ ) {
+        lo[i] = _mm_set1_epi8( (char)set->lo[i] );
+        ln[i] = _mm_set1_epi8( (char)( set->hi[i] - set->lo[i] ) );
+    }
+    
+    while( end - loc >= 16 ) {
+        __m128i x   = _mm_loadu_si128( (__m128i const*)loc );
+        __m128i acc = _mm_setzero_si128();
+        for( unsigned i = 0 ; i < set->nranges ; i++ ) {
+            __m128i d = _mm_sub_epi8( x, lo[i] );
+            acc = _mm_or_si128( acc, _mm_cmpeq_epi8( _mm_min_epu8( d, ln[i] ), d ) );
+        }
+        unsigned mask = (unsigned)_mm_movemask_epi8( acc ) ^ 0xFFFF;
+        if( mask )
+            return loc + __builtin_ctz( mask );
+        loc += 16;
+    }
+    return spanScalar( set, loc, end );
+}
+
+__attribute__((target("avx2")))
+static char const* spanAVX2( ss_ByteSet const* set, char const* loc, char const* end ) {
+    __m256i lo[SPAN_RANGES];
+    __m256i ln[SPAN_RANGES];
+    for( unsigned i = 0 ; i < set->nranges ; i++ ) {
+        lo[i] = _mm256_set1_epi8( (char)set->lo[i] );
+        ln[i] = _mm256_set1_epi8( (char)( set->hi[i] - set->lo[i] ) );
+    }
+    
+    while( end - loc >= 32 ) {
+        __m256i x   = _mm256_loadu_si256( (__m256i const*)loc );
+        __m256i acc = _mm256_setzero_si256();
+        for( unsigned i = 0 ; i < set->nranges ; i++ ) {
+            __m256i d = _mm256_sub_epi8( x, lo[i] );
+            acc = _mm256_or_si256( acc, _mm256_cmpeq_epi8( _mm256_min_epu8( d, ln[i] ), d ) );
+        }
+        unsigned mask = ~(unsigned)_mm256_movemask_epi8( acc );
+        if( mask )
+            return loc + __builtin_ctz( mask );
+        loc += 32;
+    }
+    return spanSSE2( set, loc, end );
+}
+#endif
+
+/* Kernels are picked when a pattern is compiled and kept in its sets
+   and filters, so threads sharing a compiled pattern only ever read the
+   choice. */
+static ss_SpanKernel spanKernel( void ) {
+#ifdef ss_X86
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports( "avx2" ) )
+        return spanAVX2;
+    if( __builtin_cpu_supports( "sse2" ) )
+        return spanSSE2;
+#endif
+    return spanScalar;
+}
+
+/* Finds the end of the run of bytes in the set starting at `loc`.  Sets
+   that exclude just one byte are left to `memchr()`. */
+static char const* spanBytes( ss_ByteSet const* set, char const* loc, char const* end ) {
+    if( set->stop >= 0 ) {
+        char const* at = memchr( loc, set->stop, end - loc );
+        return at ? at : end;
+    }
+    if( set->nranges == 0 )
+        return spanScalar( set, loc, end );
+    return set->kernel( set, loc, end );
+}
+
+/* Binary search over a sorted table of disjoint inclusive ranges, kept
+   as pairs of bounds. */
+static bool inRanges( long const* ranges, size_t nranges, long chr ) {
+    size_t lo = 0;
+    size_t hi = nranges;
+    while( lo < hi ) {
+        size_t mid = lo + ( hi - lo )/2;
+        if( chr < ranges[2*mid] )
+            hi = mid;
+        else
+        if( chr > ranges[2*mid + 1] )
+            lo = mid + 1;
+        else
+            return true;
+    }
+    return false;
+}
+
+static bool spanHas( ss_Span const* span, long chr ) {
+    if( chr < 0 )
+        return false;
+    if( chr > 255 )
+        return span->wide || inRanges( span->ranges, span->nranges, chr );
+    return ss_bitGet( span->bytes.bits, chr );
+}
+
+static bool stopsAt( ss_Span const* span, char const* loc, char const* end ) {
+    if( (size_t)( end - loc ) < span->stoplen )
+        return false;
+    for( size_t i = 0 ; i < span->stoplen ; i++ ) {
+        if( (unsigned char)loc[i] != span->stop[i] )
+            return false;
+    }
+    return true;
+}
+
+/* End of the input a run of at most `max` bytes could reach. */
+static char const* spanLimit( char const* loc, char const* end, size_t max ) {
+    if( (size_t)( end - loc ) > max )
+        return loc + max;
+    return end;
+}
+
+/* Consumes a run of up to `max` symbols in the span, stopping at the
+   first occurrence of its terminator.  Byte streams find candidates for
+   the terminator with `memchr()` over the run, character streams check
+   each position. */
+static size_t spanUntil( ss_Context* ctx, ss_Span const* span, size_t max, ss_Stream* stream ) {
+    if( stream->fmt == ss_BYTES ) {
+        char const* loc = stream->loc;
+        char const* run = spanBytes( &span->bytes, loc, spanLimit( loc, stream->end, max ) );
+        char const* at  = loc;
+        while( span->stop[0] < 256 && at < run ) {
+            at = memchr( at, (int)span->stop[0], run - at );
+            if( !at || stopsAt( span, at, stream->end ) )
+                break;
+            at++;
+        }
+        if( !at || span->stop[0] > 255 )
+            at = run;
+        
+        stream->loc = at;
+        return at - loc;
+    }
+    
+    size_t cnt = 0;
+    while( cnt < max ) {
+        ss_Stream peek = *stream;
+        size_t    i    = 0;
+        while( i < span->stoplen && peek.read( ctx, &peek ) == span->stop[i] )
+            i++;
+        if( i == span->stoplen )
+            break;
+        
+        peek = *stream;
+        if( !spanHas( span, peek.read( ctx, &peek ) ) )
+            break;
+        *stream = peek;
+        cnt++;
+    }
+    return cnt;
+}
+
+/* Consumes the longest run of up to `max` symbols in the span, returning
+   the number of symbols consumed.  Runs of ASCII in character streams go
+   through the byte kernel, anything else is decoded one character at a
+   time. */
+static size_t spanStream( ss_Context* ctx, ss_Span const* span, size_t max, ss_Stream* stream ) {
+    if( span->stoplen )
+        return spanUntil( ctx, span, max, stream );
+    
+    if( stream->fmt == ss_BYTES ) {
+        char const* loc = stream->loc;
+        stream->loc = spanBytes( &span->bytes, loc, spanLimit( loc, stream->end, max ) );
+        return stream->loc - loc;
+    }
+    
+    size_t cnt = 0;
+    while( cnt < max && stream->loc < stream->end ) {
+        char const* loc = stream->loc;
+        stream->loc = spanBytes( &span->ascii, loc, spanLimit( loc, stream->end, max - cnt ) );
+        cnt += stream->loc - loc;
+        if( cnt == max )
+            break;
+        
+        ss_Stream peek = *stream;
+        if( !spanHas( span, peek.read( ctx, &peek ) ) )
+            break;
+        *stream = peek;
+        cnt++;
+    }
+    return cnt;
+}
+
+/* A run that reaches the end of an open stream might go on, so it
+   waits for more input like a read past the end would. */
+static ss_Match* spanMatcher( ss_Context* ctx, ss_Span const* span, size_t min, size_t max, ss_Stream* stream ) {
+    char const* loc = stream->loc;
+    size_t      cnt = spanStream( ctx, span, max, stream );
+    if( stream->open && cnt < max && stream->loc == stream->end )
+        ss_starve( ctx );
+    if( cnt < min || ctx->starved ) {
+        stream->loc = loc;
+        return NULL;
+    }
+    
+    return newMatch( ctx, 0, loc, stream->loc );
+}
+
+
+/********************************* Prefilters *********************************/
+
+static char const* teddyScalar( ss_Filter const* filter, char const* loc, char const* end ) {
+    for( ; (size_t)( end - loc ) >= filter->teddy ; loc++ ) {
+        unsigned char hit = 0xFF;
+        for( unsigned j = 0 ; j < filter->teddy ; j++ ) {
+            unsigned char b = (unsigned char)loc[j];
+            hit &= filter->lo[j][b & 15] & filter->hi[j][b >> 4];
+        }
+        if( hit )
+            return loc;
+    }
+    return end;
+}
+
+#ifdef ss_X86
+/* Looks up the buckets for the low and high nibble of each byte with a
+   shuffle and ands the results over the leading bytes, so any non-zero
+   byte marks a position where some literal's leading bytes could start. */
+__attribute__((target("ssse3")))
+static char const* teddySSSE3( ss_Filter const* filter, char const* loc, char const* end ) {
+    __m128i nib = _mm_set1_epi8( 0x0F );
+    __m128i lo[TEDDY_WIDTH];
+    __m128i hi[TEDDY_WIDTH];
+    for( unsigned j = 0 ; j < filter->teddy ; j++ ) {
+        lo[j] = _mm_loadu_si128( (__m128i const*)filter->lo[j] );
+        hi[j] = _mm_loadu_si128( (__m128i const*)filter->hi[j] );
+    }
+    
+    while( (size_t)( end - loc ) >= 16 + filter->teddy - 1 ) {
+        __m128i acc = _mm_set1_epi8( -1 );
+        for( unsigned j = 0 ; j < filter->teddy ; j++ ) {
+            __m128i x = _mm_loadu_si128( (__m128i const*)( loc + j ) );
+            __m128i l = _mm_shuffle_epi8( lo[j], _mm_and_si128( x, nib ) );
+            __m128i h = _mm_shuffle_epi8( hi[j], _mm_and_si128( _mm_srli_epi16( x, 4 ), nib ) );
+            acc = _mm_and_si128( acc, _mm_and_si128( l, h ) );
+        }
+        unsigned mask = (unsigned)_mm_movemask_epi8( _mm_cmpeq_epi8( acc, _mm_setzero_si128() ) ) ^ 0xFFFF;
+        if( mask )
+            return loc + __builtin_ctz( mask );
+        loc += 16;
+    }
+    return teddyScalar( filter, loc, end );
+}
+
+__attribute__((target("avx2")))
+static char const* teddyAVX2( ss_Filter const* filter, char const* loc, char const* end ) {
+    __m256i nib = _mm256_set1_epi8( 0x0F );
+    __m256i lo[TEDDY_WIDTH];
+    __m256i hi[TEDDY_WIDTH];
+    for( unsigned j = 0 ; j < filter->teddy ; j++ ) {
+        lo[j] = _mm256_broadcastsi128_si256( _mm_loadu_si128( (__m128i const*)filter->lo[j] ) );
+        hi[j] = _mm256_broadcastsi128_si256( _mm_loadu_si128( (__m128i const*)filter->hi[j] ) );
+    }
+    
+    while( (size_t)( end - loc ) >= 32 + filter->teddy - 1 ) {
+        __m256i acc = _mm256_set1_epi8( -1 );
+        for( unsigned j = 0 ; j < filter->teddy ; j++ ) {
+            __m256i x = _mm256_loadu_si256( (__m256i const*)( loc + j ) );
+            __m256i l = _mm256_shuffle_epi8( lo[j], _mm256_and_si256( x, nib ) );
+            __m256i h = _mm256_shuffle_epi8( hi[j], _mm256_and_si256( _mm256_srli_epi16( x, 4 ), nib ) );
+            acc = _mm256_and_si256( acc, _mm256_and_si256( l, h ) );
+        }
+        unsigned mask = ~(unsigned)_mm256_movemask_epi8( _mm256_cmpeq_epi8( acc, _mm256_setzero_si256() ) );
+        if( mask )
+            return loc + __builtin_ctz( mask );
+        loc += 32;
+    }
+    return teddySSSE3( filter, loc, end );
+}
+#endif
+
+/* Returns NULL if there's nothing better than the byte skip. */
+static ss_TeddyKernel teddyKernel( void ) {
+#ifdef ss_X86
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports( "avx2" ) )
+        return teddyAVX2;
+    if( __builtin_cpu_supports( "ssse3" ) )
+        return teddySSSE3;
+#endif
+    return NULL;
+}
+
+/* Finds the next position at or after `loc` where a match might start,
+   or `end` if there's none.  Candidates are only ever the starts of
+   symbols, since continuation bytes can't begin an encoded symbol. */
+static char const* filterSkip( ss_Filter const* filter, char const* loc, char const* end ) {
+    if( filter->kernel )
+        return filter->kernel( filter, loc, end );
+    if( filter->skip )
+        return spanBytes( &filter->starts, loc, end );
+    return loc;
+}
+
+/* Finds the required bytes of a filter at or after `loc`, returning NULL
+   if they aren't there.  Filters without any are satisfied at `loc`. */
+static char const* filterNeed( ss_Filter const* filter, char const* loc, char const* end ) {
+    if( filter->needed == 0 )
+        return loc;
+    
+    char const* last = end - filter->needed;
+    while( loc <= last ) {
+        loc = memchr( loc, filter->need[0], (size_t)( last - loc ) + 1 );
+        if( !loc )
+            return NULL;
+        if( memcmp( loc + 1, filter->need + 1, filter->needed - 1 ) == 0 )
+            return loc;
+        loc++;
+    }
+    return NULL;
+}
+
+
+/**************************** Primitive Patterns ******************************/
+static void freeFilter( ss_Filter* filter ) {
+    if( filter ) {
+        ss_dealloc( filter[ss_BYTES].rest );
+        ss_dealloc( filter[ss_CHARS].rest );
+        ss_dealloc( filter );
+    }
+}
+
+static void freePattern( void* ptr ) {
+    ss_Pattern* pat = ptr;
+    if( pat->clean )
+        pat->clean( NULL, pat );
+    if( pat->binding )
+        ss_dealloc( pat->binding );
+    freeFilter( pat->filter );
+    ss_free( pat );
+}
+
+static void freeMatch( void* ptr ) {
+    ss_Match* match = ptr;
+    if( match->scope )
+        ss_release( match->scope );
+    for( size_t i = 0 ; i < match->count ; i++ )
+        ss_release( match->items[i] );
+    ss_dealloc( match->items );
+    ss_dealloc( match->caps );
+    ss_free( match );
+}
+
+typedef struct {
+    ss_Pattern  pat;
+    size_t      count;
+    ss_Pattern* patterns[];
+} AllOfPattern;
+
+/* Matches each part in turn.  Given `rest`, a pair of bounds on what the
+   parts after each one can consume, the walk fails as soon as the bytes
+   left in the stream fall outside them once a part has matched.  The
+   parts themselves are matched unbounded.  A feed resumes the walk at
+   the part its input ran out in. */
+static ss_Match* allOfWalk( ss_Context* ctx, ss_Pattern* p, size_t scope, ss_Stream* stream, size_t const* rest ) {
+    AllOfPattern* allOfPat = (AllOfPattern*)p;
+    
+    char const* loc = stream->loc;
+    size_t      i   = 0;
+    if( ss_resuming( ctx ) ) {
+        ss_Frame const* frame = feedResume( ctx, FRAME_ALL_OF, p, loc );
+        if( frame ) {
+            i           = frame->index;
+            stream->loc = frame->at;
+            if( rest )
+                rest += 2*i;
+        }
+    }
+    
+    for( ; i < allOfPat->count ; i++ ) {
+        char const* at  = stream->loc;
+        ss_Pattern* nxt = allOfPat->patterns[i];
+        ss_Match*   sub = nxt->match( ctx, nxt, scope, stream );
+        if( !sub ) {
+            if( ctx->starved )
+                feedSuspend( ctx, &(ss_Frame){ .kind = FRAME_ALL_OF, .pat = p, .loc = loc, .at = at, .index = i } );
+            return NULL;
+        }
+        ss_release( sub );
+        
+        if( rest ) {
+            size_t left = (size_t)( stream->end - stream->loc );
+            if( left < rest[0] || left > rest[1] )
+                return NULL;
+            rest += 2;
+        }
+    }
+    char const* end = stream->loc;
+    
+    return newMatch( ctx, scope, loc, end );
+}
+
+static ss_Match* allOfMatcher( ss_Context* ctx, ss_Pattern* p, size_t scope, ss_Stream* stream ) {
+    if( ss_halted( ctx, stream ) )
+        return NULL;
+    
+    return allOfWalk( ctx, p, scope, stream, NULL );
+}
+
+static void allOfCleaner( ss_Context* ctx, ss_Pattern* pat ) {
+    AllOfPattern* allOfPat = (AllOfPattern*)pat;
+    for( size_t i = 0 ; i < allOfPat->count ; i++ )
+        ss_release( allOfPat->patterns[i] );
+}
+
+/* The parts are copied out of the compiler's list into the pattern
+   itself, so matching walks an array instead of chasing list nodes. */
+static ss_Pattern* ss_allOfPattern( ss_Context* ctx, ss_List* patterns ) {
+    size_t count = 0;
+    for( ss_ListNode* it = patterns->first ; it ; it = it->next )
+        count++;
+    
+    AllOfPattern* allOfPat = ss_alloc( ctx, sizeof(AllOfPattern) + sizeof(ss_Pattern*)*count, TYPE_PATTERN );
+    if( !allOfPat ) {
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        return NULL;
+    }
+    allOfPat->pat.kind    = KIND_ALL_OF;
+    allOfPat->pat.depth   = ss_listDepth( patterns ) + 1;
+    allOfPat->pat.match   = allOfMatcher;
+    allOfPat->pat.clean   = allOfCleaner;
+    allOfPat->pat.binding = NULL;
+    allOfPat->pat.filter  = NULL;
+    allOfPat->count       = count;
+    
+    size_t i = 0;
+    for( ss_ListNode* it = patterns->first ; it ; it = it->next )
+        allOfPat->patterns[i++] = ss_refer( it->value );
+    return (ss_Pattern*)allOfPat;
+}
+
+
+/* Buckets for the first symbol dispatch table, one for each byte
+   sized symbol, one for all wider symbols, and one for the end of
+   input (or undecodable input). */
+#define DISPATCH_WIDE 256
+#define DISPATCH_END  257
+#define DISPATCH_SIZE 258
+
+/* Literal alternation trie nodes.  Each node holds the symbol leading
+   to it, the range of `nodes` holding its children, the alternative
+   that ends at it (if any) and the earliest alternative below it. */
+#define TRIE_NONE ((unsigned)-1)
+
+typedef struct {
+    long     sym;
+    size_t   kids;
+    unsigned nkids;
+    unsigned term;
+    unsigned min;
+} TrieNode;
+
+typedef struct {
+    ss_Pattern   pat;
+    
+    /* Optionally a table mapping the next input symbol to the
+       alternatives that can possibly start with it.  The alternatives
+       for bucket `b` are at `table[offsets[b]]` up to
+       `table[offsets[b+1]]`. */
+    unsigned*    table;
+    unsigned*    offsets;
+    
+    /* If every alternative is an unbound literal, a trie of them
+       that's walked instead of trying each alternative in turn. */
+    TrieNode*    trie;
+    size_t       nodes;
+    
+    /* The alternatives in priority order. */
+    size_t       count;
+    ss_Pattern*  alts[];
+} OneOfPattern;
+
+static unsigned dispatchBucket( long ch ) {
+    if( ch < 0 )
+        return DISPATCH_END;
+    if( ch > 255 )
+        return DISPATCH_WIDE;
+    return (unsigned)ch;
+}
+
+static bool isViable( ss_First const* first, unsigned bucket ) {
+    if( first->empty )
+        return true;
+    if( bucket == DISPATCH_END )
+        return false;
+    if( bucket == DISPATCH_WIDE )
+        return first->wide;
+    return ss_bitGet( first->bits, bucket );
+}
+
+static TrieNode const* trieChild( TrieNode const* nodes, TrieNode const* node, long sym ) {
+    size_t lo = node->kids;
+    size_t hi = node->kids + node->nkids;
+    while( lo < hi ) {
+        size_t mid = lo + ( hi - lo )/2;
+        if( sym < nodes[mid].sym )
+            hi = mid;
+        else
+        if( sym > nodes[mid].sym )
+            lo = mid + 1;
+        else
+            return &nodes[mid];
+    }
+    return NULL;
+}
+
+/* Ordered choice between literals picks the earliest alternative that's
+   a prefix of the input, so the walk follows the input down the trie
+   remembering the earliest alternative ending on the way, and stops as
+   soon as nothing further down could beat it. */
+static ss_Match* trieMatcher( ss_Context* ctx, OneOfPattern* oneOfPat, size_t scope, ss_Stream* stream ) {
+    TrieNode const* nodes = oneOfPat->trie;
+    TrieNode const* node  = nodes;
+    
+    char const* loc  = stream->loc;
+    unsigned    best = node->term;
+    ss_Stream   end  = *stream;
+    while( node->nkids && node->min < best ) {
+        node = trieChild( nodes, node, stream->read( ctx, stream ) );
+        if( !node || node->min >= best )
+            break;
+        if( node->term < best ) {
+            best = node->term;
+            end  = *stream;
+        }
+    }
+    *stream = end;
+    if( best == TRIE_NONE || ctx->starved )
+        return NULL;
+    
+    return newMatch( ctx, scope, loc, stream->loc );
+}
+
+static ss_Match* oneOfMatcher( ss_Context* ctx, ss_Pattern* p, size_t scope, ss_Stream* stream ) {
+    OneOfPattern* oneOfPat = (OneOfPattern*)p;
+    
+    if( ss_halted( ctx, stream ) )
+        return NULL;
+    
+    if( oneOfPat->trie )
+        return trieMatcher( ctx, oneOfPat, scope, stream );
+    
+    unsigned const* sel = NULL;
+    size_t          cnt = oneOfPat->count;
+    if( oneOfPat->table ) {
+        ss_Stream peek   = *stream;
+        unsigned  bucket = dispatchBucket( peek.read( ctx, &peek ) );
+        sel = oneOfPat->table + oneOfPat->offsets[bucket];
+        cnt = oneOfPat->offsets[bucket+1] - oneOfPat->offsets[bucket];
+    }
+    
+    size_t i    = 0;
+    size_t mark = ctx->log.count;
+    if( ss_resuming( ctx ) ) {
+        ss_Frame const* frame = feedResume( ctx, FRAME_ONE_OF, p, stream->loc );
+        if( frame ) {
+            i    = frame->index;
+            mark = frame->mark;
+        }
+    }
+    
+    for( ; i < cnt ; i++ ) {
+        ss_Pattern* nxt   = oneOfPat->alts[sel ? sel[i] : i];
+        ss_Stream   saved = *stream;
+        
+        ss_Match* sub = nxt->match( ctx, nxt, scope, stream );
+        if( sub )
+            return sub;
+        if( ctx->starved ) {
+            feedSuspend( ctx, &(ss_Frame){ .kind = FRAME_ONE_OF, .pat = p, .loc = saved.loc, .index = i, .mark = mark } );
+            return NULL;
+        }
+        *stream = saved;
+        ctx->log.count = mark;
+    }
+    return NULL;
+}
+
+static void oneOfCleaner( ss_Context* ctx, ss_Pattern* p ) {
+    OneOfPattern* oneOfPat = (OneOfPattern*)p;
+    for( size_t i = 0 ; i < oneOfPat->count ; i++ )
+        ss_release( oneOfPat->alts[i] );
+    ss_dealloc( oneOfPat->table );
+    ss_dealloc( oneOfPat->offsets );
+    ss_dealloc( oneOfPat->trie );
+}
+
+/* Builds the first symbol dispatch table for an alternation.  The
+   table is left out when it wouldn't prune anything worthwhile, in
+   which case every alternative is just attempted in order. */
+static int oneOfDispatch( ss_Context* ctx, OneOfPattern* oneOfPat ) {
+    size_t count = oneOfPat->count;
+    if( count < 2 )
+        return 0;
+    
+    ss_First* firsts = ss_malloc( ctx->heap, sizeof(ss_First)*count );
+    if( !firsts ) {
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        return -1;
+    }
+    for( size_t i = 0 ; i < count ; i++ )
+        ss_first( oneOfPat->alts[i], &firsts[i] );
+    
+    size_t total = 0;
+    for( unsigned b = 0 ; b < DISPATCH_SIZE ; b++ ) {
+        for( size_t i = 0 ; i < count ; i++ ) {
+            if( isViable( &firsts[i], b ) )
+                total++;
+        }
+    }
+    if( total > count*DISPATCH_SIZE/2 ) {
+        ss_dealloc( firsts );
+        return 0;
+    }
+    
+    unsigned* offsets = ss_malloc( ctx->heap, sizeof(unsigned)*(DISPATCH_SIZE + 1) );
+    unsigned* table   = ss_malloc( ctx->heap, sizeof(unsigned)*( total ? total : 1 ) );
+    if( !offsets || !table ) {
+        ss_dealloc( offsets );
+        ss_dealloc( table );
+        ss_dealloc( firsts );
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        return -1;
+    }
+    
+    unsigned top = 0;
+    for( unsigned b = 0 ; b < DISPATCH_SIZE ; b++ ) {
+        offsets[b] = top;
+        for( size_t i = 0 ; i < count ; i++ ) {
+            if( isViable( &firsts[i], b ) )
+                table[top++] = (unsigned)i;
+        }
+    }
+    offsets[DISPATCH_SIZE] = top;
+    ss_dealloc( firsts );
+    
+    oneOfPat->table   = table;
+    oneOfPat->offsets = offsets;
+    return 0;
+}
+
+typedef struct {
+    long const* str;
+    size_t      len;
+    unsigned    idx;
+} TrieEntry;
+
+typedef struct {
+    size_t node;
+    size_t lo;
+    size_t hi;
+    size_t depth;
+} TrieWork;
+
+static int compareEntries( void const* a, void const* b ) {
+    TrieEntry const* ea = a;
+    TrieEntry const* eb = b;
+    for( size_t i = 0 ; i < ea->len && i < eb->len ; i++ ) {
+        if( ea->str[i] != eb->str[i] )
+            return ea->str[i] < eb->str[i] ? -1 : 1;
+    }
+    if( ea->len != eb->len )
+        return ea->len < eb->len ? -1 : 1;
+    return ( ea->idx > eb->idx ) - ( ea->idx < eb->idx );
+}
+
+/* Builds a trie over an alternation's literals, if they're all unbound
+   literals.  The literals are sorted so each node's children cover a
+   contiguous run of them, and the nodes are laid out from a work list
+   rather than by recursion since literals can be arbitrarily long.  The
+   children of a node are adjacent and sorted by symbol. */
+static int oneOfTrie( ss_Context* ctx, OneOfPattern* oneOfPat ) {
+    size_t count = oneOfPat->count;
+    if( count < 2 )
+        return 0;
+    
+    size_t total = 1;
+    for( size_t i = 0 ; i < count ; i++ ) {
+        size_t len;
+        if( !ss_stringOf( oneOfPat->alts[i], &len ) )
+            return 0;
+        total += len;
+    }
+    
+    TrieEntry* entries = ss_malloc( ctx->heap, sizeof(TrieEntry)*count );
+    TrieWork*  work    = ss_malloc( ctx->heap, sizeof(TrieWork)*total );
+    TrieNode*  nodes   = ss_malloc( ctx->heap, sizeof(TrieNode)*total );
+    if( !entries || !work || !nodes ) {
+        ss_dealloc( entries );
+        ss_dealloc( work );
+        ss_dealloc( nodes );
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        return -1;
+    }
+    
+    for( size_t i = 0 ; i < count ; i++ ) {
+        entries[i].str = ss_stringOf( oneOfPat->alts[i], &entries[i].len );
+        entries[i].idx = (unsigned)i;
+    }
+    qsort( entries, count, sizeof(TrieEntry), compareEntries );
+    
+    size_t top  = 1;
+    size_t todo = 0;
+    nodes[0].sym = -1;
+    work[todo++] = (TrieWork){ .node = 0, .lo = 0, .hi = count, .depth = 0 };
+    while( todo ) {
+        TrieWork  w    = work[--todo];
+        TrieNode* node = &nodes[w.node];
+        
+        node->term = TRIE_NONE;
+        node->min  = TRIE_NONE;
+        for( size_t i = w.lo ; i < w.hi ; i++ ) {
+            if( entries[i].idx < node->min )
+                node->min = entries[i].idx;
+            if( entries[i].len == w.depth && entries[i].idx < node->term )
+                node->term = entries[i].idx;
+        }
+        
+        size_t i = w.lo;
+        while( i < w.hi && entries[i].len == w.depth )
+            i++;
+        
+        node->kids  = top;
+        node->nkids = 0;
+        while( i < w.hi ) {
+            long   sym = entries[i].str[w.depth];
+            size_t j   = i;
+            while( j < w.hi && entries[j].str[w.depth] == sym )
+                j++;
+            
+            nodes[top].sym = sym;
+            work[todo++]   = (TrieWork){ .node = top, .lo = i, .hi = j, .depth = w.depth + 1 };
+            node->nkids++;
+            top++;
+            i = j;
+        }
+    }
+    
+    ss_dealloc( entries );
+    ss_dealloc( work );
+    oneOfPat->trie  = nodes;
+    oneOfPat->nodes = top;
+    return 0;
+}
+
+static ss_Pattern* ss_oneOfPattern( ss_Context* ctx, ss_List* patterns ) {
+    size_t count = 0;
+    for( ss_ListNode* it = patterns->first ; it ; it = it->next )
+        count++;
+    
+    OneOfPattern* oneOfPat = ss_alloc( ctx, sizeof(OneOfPattern) + sizeof(ss_Pattern*)*count, TYPE_PATTERN );
+    if( !oneOfPat ) {
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        return NULL;
+    }
+    oneOfPat->pat.kind    = KIND_ONE_OF;
+    oneOfPat->pat.depth   = ss_listDepth( patterns ) + 1;
+    oneOfPat->pat.match   = oneOfMatcher;
+    oneOfPat->pat.clean   = oneOfCleaner;
+    oneOfPat->pat.binding = NULL;
+    oneOfPat->pat.filter  = NULL;
+    oneOfPat->table       = NULL;
+    oneOfPat->offsets     = NULL;
+    oneOfPat->trie        = NULL;
+    oneOfPat->nodes       = 0;
+    oneOfPat->count       = count;
+    
+    size_t i = 0;
+    for( ss_ListNode* it = patterns->first ; it ; it = it->next )
+        oneOfPat->alts[i++] = ss_refer( it->value );
+    
+    size_t symbols = 0;
+    while( symbols < oneOfPat->count && ss_symbolsOf( oneOfPat->alts[symbols] ) )
+        symbols++;
+    if( oneOfPat->count > 1 && symbols == oneOfPat->count ) {
+        ss_Pattern* unionPat = ss_unionPattern( ctx, oneOfPat->alts, oneOfPat->count );
+        ss_release( oneOfPat );
+        return unionPat;
+    }
+    
+    if( oneOfTrie( ctx, oneOfPat ) ) {
+        ss_release( oneOfPat );
+        return NULL;
+    }
+    if( !oneOfPat->trie && oneOfDispatch( ctx, oneOfPat ) ) {
+        ss_release( oneOfPat );
+        return NULL;
+    }
+    return (ss_Pattern*)oneOfPat;
+}
+
+
+typedef struct {
+    ss_Pattern  pat;
+    ss_Pattern* wrapped;
+} HasNextPattern;
+
+static ss_Match* hasNextMatcher( ss_Context* ctx, ss_Pattern* p, size_t scope, ss_Stream* stream ) {
+    HasNextPattern* hasNextPat = (HasNextPattern*)p;
+    
+    if( ss_halted( ctx, stream ) )
+        return NULL;
+    
+    ss_Stream saved = *stream;
+    ss_Pattern* pat = hasNextPat->wrapped;
+    ss_Match*   match = pat->match( ctx, pat, scope, stream );
+    
+    *stream = saved;
+    
+    return match;
+}
+
+static void hasNextCleaner( ss_Context* ctx, ss_Pattern* p ) {
+    HasNextPattern* hasNextPat = (HasNextPattern*)p;
+    ss_release( hasNextPat->wrapped );
+}
+
+static ss_Pattern* ss_hasNextPattern( ss_Context* ctx, ss_Pattern* pattern ) {
+    HasNextPattern* hasNextPat = ss_alloc( ctx, sizeof(HasNextPattern), TYPE_PATTERN );
+    if( !hasNextPat ) {
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        return NULL;
+    }
+    hasNextPat->pat.kind    = KIND_HAS_NEXT;
+    hasNextPat->pat.depth   = pattern->depth + 1;
+    hasNextPat->pat.match   = hasNextMatcher;
+    hasNextPat->pat.clean   = hasNextCleaner;
+    hasNextPat->pat.binding = NULL;
+    hasNextPat->pat.filter  = NULL;
+    hasNextPat->wrapped     = ss_refer( pattern );
+    return (ss_Pattern*)hasNextPat;
+}
+
+
+typedef struct {
+    ss_Pattern  pat;
+    ss_Pattern* wrapped;
+} NotNextPattern;
+
+static ss_Match* notNextMatcher( ss_Context* ctx, ss_Pattern* p, size_t scope, ss_Stream* stream ) {
+    NotNextPattern* notNextPat = (NotNextPattern*)p;
+    
+    if( ss_halted( ctx, stream ) )
+        return NULL;
+    
+    char const* loc  = stream->loc;
+    size_t      mark = ctx->log.count;
+    
+    ss_Stream   saved = *stream;
+    ss_Pattern* pat   = notNextPat->wrapped;
+    ss_Match*   match = pat->match( ctx, pat, 0, stream );
+    
+    *stream = saved;
+    ctx->log.count = mark;
+    
+    if( match ) {
+        ss_release( match );
+        return NULL;
+    }
+    if( ctx->starved )
+        return NULL;
+    
+    return newMatch( ctx, 0, loc, loc );
+}
+
+static void notNextCleaner( ss_Context* ctx, ss_Pattern* p ) {
+    NotNextPattern* notNextPat = (NotNextPattern*)p;
+    ss_release( notNextPat->wrapped );
+}
+
+static ss_Pattern* ss_notNextPattern( ss_Context* ctx, ss_Pattern* pattern ) {
+    NotNextPattern* notNextPat = ss_alloc( ctx, sizeof(NotNextPattern), TYPE_PATTERN );
+    if( !notNextPat ) {
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        return NULL;
+    }
+    notNextPat->pat.kind    = KIND_NOT_NEXT;
+    notNextPat->pat.depth   = pattern->depth + 1;
+    notNextPat->pat.match   = notNextMatcher;
+    notNextPat->pat.clean   = notNextCleaner;
+    notNextPat->pat.binding = NULL;
+    notNextPat->pat.filter  = NULL;
+    notNextPat->wrapped     = ss_refer( pattern );
+    return (ss_Pattern*)notNextPat;
+}
+
+
+/* Makes a match of the input from `loc` to `end`, carrying `scope` if
+   there is one.  Nothing looks inside a match until the whole pattern
+   has matched, so every matcher hands out the context's token and
+   leaves what the match was in `ctx->last`, to be logged if it's bound
+   or kept.  ss_matchMany() gets by with the token alone. */
+static ss_Match* newMatch( ss_Context* ctx, size_t scope, char const* loc, char const* end ) {
+    ctx->last = (ss_Capture){ .loc = loc, .end = end, .own = scope };
+    return ss_refer( ctx->token );
+}
+
+/* Logs the match just made as bound to `site` in `scope`, or with no
+   site as a copy following copy `prev`.  Returns the entry's place in
+   the log plus one, or zero if there's no room for it. */
+static size_t logCapture( ss_Context* ctx, char const* site, size_t scope, size_t prev ) {
+    ss_Log* log = &ctx->log;
+    if( log->count == log->cap ) {
+        size_t      cap  = log->cap ? log->cap*2 : 16;
+        ss_Capture* caps = ss_realloc( ctx->heap, log->caps, sizeof(ss_Capture)*cap );
+        if( !caps ) {
+            ss_error( ctx, ss_ERR_ALLOC, NULL );
+            return 0;
+        }
+        log->caps = caps;
+        log->cap  = cap;
+    }
+    ss_Capture* cap = &log->caps[log->count++];
+    *cap       = ctx->last;
+    cap->site  = site;
+    cap->scope = scope;
+    cap->prev  = prev;
+    return log->count;
+}
+
+/* Matches a pattern in a scope of its own if anything under it binds.
+   Opening a scope only numbers it, and a match that fails takes what
+   it logged with it.  A feed keeps the scope's number while it waits
+   for more input. */
+static ss_Match* scopedMatch( ss_Context* ctx, ss_Pattern* pat, bool scoped, ss_Stream* stream ) {
+    char const* loc   = stream->loc;
+    size_t      mark  = ctx->log.count;
+    size_t      scope = 0;
+    if( scoped && !ctx->bare ) {
+        ss_Frame const* frame = ss_resuming( ctx ) ? feedResume( ctx, FRAME_SCOPE, pat, loc ) : NULL;
+        if( frame ) {
+            scope = frame->scope;
+            mark  = frame->mark;
+        }
+        else {
+            scope = ++ctx->log.scopes;
+        }
+    }
+    
+    ss_Match* match = pat->match( ctx, pat, scope, stream );
+    if( !match ) {
+        if( ctx->starved ) {
+            if( scope )
+                feedSuspend( ctx, &(ss_Frame){ .kind = FRAME_SCOPE, .pat = pat, .loc = loc, .mark = mark, .scope = scope } );
+            return NULL;
+        }
+        ctx->log.count = mark;
+    }
+    return match;
+}
+
+
+/* Matches copies of a repetition's body until one fails or `max` have
+   matched, returning a match that covers the whole run.  If the
+   repetition is bound the copies are kept, logged in a chain from the
+   last back to the first, so ss_getIndex() can pick any of them out,
+   and the run shares the scope of its first copy so bindings inside it
+   can be reached directly.  Otherwise nothing can reach them, so
+   they're dropped as soon as they've matched.  A copy that consumed
+   nothing will do the same every time, so it stands in for any copies
+   still required.  A feed picks up from the copy its input ran out
+   in. */
+static ss_Match* repeatMatcher( ss_Context* ctx, ss_Pattern* pat, bool scoped, bool keep, size_t min, size_t max, ss_Stream* stream ) {
+    ss_Stream start = *stream;
+    size_t    own   = 0;
+    size_t    count = 0;
+    size_t    last  = 0;
+    size_t    done  = 0;
+    if( ss_resuming( ctx ) ) {
+        ss_Frame const* frame = feedResume( ctx, FRAME_REPEAT, pat, start.loc );
+        if( frame ) {
+            own         = frame->scope;
+            count       = frame->count;
+            last        = frame->last;
+            done        = frame->index;
+            stream->loc = frame->at;
+        }
+    }
+    
+    while( done < max ) {
+        ss_Stream saved = *stream;
+        ss_Match* next  = scopedMatch( ctx, pat, scoped && keep, stream );
+        if( !next ) {
+            if( ctx->starved ) {
+                feedSuspend( ctx, &(ss_Frame){
+                    .kind  = FRAME_REPEAT,
+                    .pat   = pat,
+                    .loc   = start.loc,
+                    .at    = saved.loc,
+                    .index = done,
+                    .scope = own,
+                    .count = count,
+                    .last  = last
+                } );
+                *stream = start;
+                return NULL;
+            }
+            *stream = saved;
+            break;
+        }
+        ss_release( next );
+        done++;
+        
+        if( keep ) {
+            if( count == 0 )
+                own = ctx->last.own;
+            size_t copy = logCapture( ctx, NULL, 0, last );
+            if( copy ) {
+                last = copy;
+                count++;
+            }
+        }
+        
+        if( stream->loc == saved.loc ) {
+            if( done < min )
+                done = min;
+            break;
+        }
+    }
+    if( done < min ) {
+        *stream = start;
+        return NULL;
+    }
+    
+    ss_Match* match = newMatch( ctx, own, start.loc, stream->loc );
+    ctx->last.count = count;
+    ctx->last.items = last;
+    return match;
+}
+
+/* Turns the token a top-level match returned into a match of its own,
+   taking along what the attempt logged, with the match itself as the
+   last entry, and a copy of the binding strings.  If nothing was logged
+   there's nothing to build. */
+static ss_Match* matchResult( ss_Context* ctx, ss_Match* token ) {
+    ss_release( token );
+    
+    ss_Match* match = ss_alloc( ctx, sizeof(ss_Match), TYPE_MATCH );
+    if( !match ) {
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        return NULL;
+    }
+    *match = (ss_Match){ .loc = ctx->last.loc, .end = ctx->last.end };
+    
+    size_t count = ctx->log.count;
+    if( count ) {
+        size_t n    = count + 1;
+        size_t size = ( sizeof(ss_Capture) + sizeof(char const*) )*n;
+        for( size_t i = 0 ; i < count ; i++ ) {
+            if( ctx->log.caps[i].site )
+                size += strlen( ctx->log.caps[i].site ) + 1;
+        }
+        ss_Capture* caps = ss_malloc( ctx->heap, size );
+        if( !caps ) {
+            ss_error( ctx, ss_ERR_ALLOC, NULL );
+            ss_release( match );
+            return NULL;
+        }
+        memcpy( caps, ctx->log.caps, sizeof(ss_Capture)*count );
+        caps[count] = ctx->last;
+        
+        char const** keys = (char const**)( caps + n );
+        char*        at   = (char*)( keys + n );
+        for( size_t i = 0 ; i < n ; i++ ) {
+            keys[i] = NULL;
+            if( caps[i].site ) {
+                size_t len = strlen( caps[i].site ) + 1;
+                memcpy( at, caps[i].site, len );
+                keys[i] = at;
+                at     += len;
+            }
+        }
+        match->caps  = caps;
+        match->ncaps = n;
+    }
+    ctx->log.count = 0;
+    return match;
+}
+
+/* A binding to make in a scope, by where it was logged. */
+typedef struct {
+    size_t scope;
+    size_t index;
+} ss_Put;
+
+static int putOrder( void const* a, void const* b ) {
+    ss_Put const* x = a;
+    ss_Put const* y = b;
+    if( x->scope != y->scope )
+        return x->scope < y->scope ? -1 : 1;
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+/* The first of the bindings, sorted by scope, made in `scope`, or
+   `count` if there are none. */
+static size_t putsFind( ss_Put const* puts, size_t count, size_t scope ) {
+    size_t lo = 0;
+    size_t hi = count;
+    while( lo < hi ) {
+        size_t mid = lo + ( hi - lo )/2;
+        if( puts[mid].scope < scope )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo < count && puts[lo].scope == scope ? lo : count;
+}
+
+/* Makes the scopes and copies of a match from what was logged while it
+   was matched, the first time anything looks for them.  Each entry gets
+   a match, each scope a map committed with its bindings in the order
+   they were logged, so the first of a name wins as it always has, and
+   each run of copies an array filled by following its chain back.  If
+   there's no room the log is kept for the next look to try again. */
+static int matchBuild( ss_Context* ctx, ss_Match* match ) {
+    ss_Heap*     heap  = ctx->heap;
+    ss_Capture*  caps  = match->caps;
+    size_t       n     = match->ncaps;
+    char const** keys  = (char const**)( caps + n );
+    ss_Match**   made  = ss_calloc( heap, n, sizeof(ss_Match*) );
+    ss_Map**     maps  = ss_calloc( heap, n, sizeof(ss_Map*) );
+    ss_Put*      puts  = ss_malloc( heap, sizeof(ss_Put)*n );
+    size_t       nputs = 0;
+    int          ret   = -1;
+    if( !made || !maps || !puts )
+        goto done;
+    
+    for( size_t i = 0 ; i < n ; i++ ) {
+        made[i] = ss_alloc( ctx, sizeof(ss_Match), TYPE_MATCH );
+        if( !made[i] )
+            goto done;
+        *made[i] = (ss_Match){ .loc = caps[i].loc, .end = caps[i].end };
+        if( caps[i].site )
+            puts[nputs++] = (ss_Put){ caps[i].scope, i };
+    }
+    qsort( puts, nputs, sizeof(ss_Put), putOrder );
+    
+    for( size_t i = 0 ; i < n ; i++ ) {
+        ss_Capture const* cap = &caps[i];
+        if( cap->count ) {
+            ss_Match** items = ss_malloc( heap, sizeof(ss_Match*)*cap->count );
+            if( !items )
+                goto done;
+            size_t at = cap->items;
+            for( size_t k = cap->count ; k-- > 0 ; at = caps[at-1].prev )
+                items[k] = ss_refer( made[at-1] );
+            made[i]->items = items;
+            made[i]->count = cap->count;
+        }
+        
+        size_t first = cap->own ? putsFind( puts, nputs, cap->own ) : nputs;
+        if( first == nputs )
+            continue;
+        if( !maps[first] ) {
+            maps[first] = ss_mapNew( ctx );
+            if( !maps[first] )
+                goto done;
+            for( size_t k = first ; k < nputs && puts[k].scope == cap->own ; k++ ) {
+                size_t at = puts[k].index;
+                if( ss_mapPutSite( ctx, maps[first], keys[at], caps[at].site, made[at] ) )
+                    goto done;
+            }
+            if( ss_mapCommit( ctx, maps[first] ) )
+                goto done;
+        }
+        made[i]->scope = ss_refer( maps[first] );
+    }
+    
+    ss_Match* root = made[n-1];
+    match->scope = root->scope;
+    match->count = root->count;
+    match->items = root->items;
+    root->scope  = NULL;
+    root->count  = 0;
+    root->items  = NULL;
+    
+    ss_dealloc( match->caps );
+    match->caps  = NULL;
+    match->ncaps = 0;
+    ret = 0;
+
+done:
+    if( ret )
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+    for( size_t i = 0 ; maps && i < n ; i++ ) {
+        if( maps[i] )
+            ss_release( maps[i] );
+    }
+    for( size_t i = 0 ; made && i < n ; i++ ) {
+        if( made[i] )
+            ss_release( made[i] );
+    }
+    ss_dealloc( made );
+    ss_dealloc( maps );
+    ss_dealloc( puts );
+    return ret;
+}
+
+
+typedef struct {
+    ss_Pattern  pat;
+    ss_Pattern* wrapped;
+    bool        scoped;
+} ZeroOrOnePattern;
+
+static ss_Match* zeroOrOneMatcher( ss_Context* ctx, ss_Pattern* p, size_t scope, ss_Stream* stream ) {
+    ZeroOrOnePattern* zeroOrOnePat = (ZeroOrOnePattern*)p;
+    
+    if( ss_halted( ctx, stream ) )
+        return NULL;
+    
+    char const* loc = stream->loc;
+    
+    ss_Stream saved = *stream;
+    ss_Match* match = scopedMatch( ctx, zeroOrOnePat->wrapped, zeroOrOnePat->scoped, stream );
+    if( !match ) {
+        if( ctx->starved )
+            return NULL;
+        *stream = saved;
+        match = newMatch( ctx, 0, loc, loc );
+    }
+    if( match && zeroOrOnePat->pat.binding && scope )
+        logCapture( ctx, zeroOrOnePat->pat.binding, scope, 0 );
+    return match;
+}
+
+static void zeroOrOneCleaner( ss_Context* ctx, ss_Pattern* p ) {
+    ZeroOrOnePattern* zeroOrOnePat = (ZeroOrOnePattern*)p;
+    ss_release( zeroOrOnePat->wrapped );
+}
+
+static ss_Pattern* ss_zeroOrOnePattern( ss_Context* ctx, ss_Pattern* pattern ) {
+    ZeroOrOnePattern* zeroOrOnePat = ss_alloc( ctx, sizeof(ZeroOrOnePattern), TYPE_PATTERN );
+    if( !zeroOrOnePat ) {
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        return NULL;
+    }
+    zeroOrOnePat->pat.kind    = KIND_ZERO_OR_ONE;
+    zeroOrOnePat->pat.depth   = pattern->depth + 1;
+    zeroOrOnePat->pat.match   = zeroOrOneMatcher;
+    zeroOrOnePat->pat.clean   = zeroOrOneCleaner;
+    zeroOrOnePat->pat.binding = NULL;
+    zeroOrOnePat->pat.filter  = NULL;
+    zeroOrOnePat->wrapped     = ss_refer( pattern );
+    zeroOrOnePat->scoped      = ss_binds( pattern );
+    return (ss_Pattern*)zeroOrOnePat;
+}
+
+
+typedef struct {
+    ss_Pattern  pat;
+    ss_Pattern* wrapped;
+    ss_Span*    span;
+    bool        scoped;
+} ZeroOrMorePattern;
+
+static ss_Match* zeroOrMoreMatcher( ss_Context* ctx, ss_Pattern* p, size_t scope, ss_Stream* stream ) {
+    ZeroOrMorePattern* zeroOrMorePat = (ZeroOrMorePattern*)p;
+    
+    if( ss_halted( ctx, stream ) )
+        return NULL;
+    
+    bool bound = zeroOrMorePat->pat.binding != NULL && !ctx->bare;
+    if( zeroOrMorePat->span && !bound )
+        return spanMatcher( ctx, zeroOrMorePat->span, 0, SIZE_MAX, stream );
+    
+    ss_Match* match = repeatMatcher( ctx, zeroOrMorePat->wrapped, zeroOrMorePat->scoped, bound, 0, SIZE_MAX, stream );
+    if( match && bound && scope )
+        logCapture( ctx, zeroOrMorePat->pat.binding, scope, 0 );
+    return match;
+}
+
+static void zeroOrMoreCleaner( ss_Context* ctx, ss_Pattern* pat ) {
+    ZeroOrMorePattern* zeroOrMorePat = (ZeroOrMorePattern*)pat;
+    ss_release( zeroOrMorePat->wrapped );
+    ss_dealloc( zeroOrMorePat->span );
+}
+
+static ss_Pattern* ss_zeroOrMorePattern( ss_Context* ctx, ss_Pattern* pattern ) {
+    ZeroOrMorePattern* zeroOrMorePat = ss_alloc( ctx, sizeof(ZeroOrMorePattern), TYPE_PATTERN );
+    if( !zeroOrMorePat ) {
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        return NULL;
+    }
+    zeroOrMorePat->pat.kind    = KIND_ZERO_OR_MORE;
+    zeroOrMorePat->pat.depth   = pattern->depth + 1;
+    zeroOrMorePat->pat.match   = zeroOrMoreMatcher;
+    zeroOrMorePat->pat.clean   = zeroOrMoreCleaner;
+    zeroOrMorePat->pat.binding = NULL;
+    zeroOrMorePat->pat.filter  = NULL;
+    zeroOrMorePat->wrapped     = ss_refer( pattern );
+    zeroOrMorePat->span        = ss_spanOf( ctx, pattern );
+    zeroOrMorePat->scoped      = ss_binds( pattern );
+    return (ss_Pattern*)zeroOrMorePat;
+}
+
+
+typedef struct {
+    ss_Pattern  pat;
+    ss_Pattern* wrapped;
+    bool        scoped;
+} JustOnePattern;
+
+static ss_Match* justOneMatcher( ss_Context* ctx, ss_Pattern* p, size_t scope, ss_Stream* stream ) {
+    JustOnePattern* justOnePat = (JustOnePattern*)p;
+    
+    if( ss_halted( ctx, stream ) )
+        return NULL;
+    
+    ss_Match* match = scopedMatch( ctx, justOnePat->wrapped, justOnePat->scoped, stream );
+    if( match && justOnePat->pat.binding && scope )
+        logCapture( ctx, justOnePat->pat.binding, scope, 0 );
+    return match;
+}
+
+static void justOneCleaner( ss_Context* ctx, ss_Pattern* p ) {
+    JustOnePattern* justOnePat = (JustOnePattern*)p;
+    ss_release( justOnePat->wrapped );
+}
+
+static ss_Pattern* ss_justOnePattern( ss_Context* ctx, ss_Pattern* pattern ) {
+    JustOnePattern* justOnePat = ss_alloc( ctx, sizeof(JustOnePattern), TYPE_PATTERN );
+    if( !justOnePat ) {
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        return NULL;
+    }
+    justOnePat->pat.kind    = KIND_JUST_ONE;
+    justOnePat->pat.depth   = pattern->depth + 1;
+    justOnePat->pat.match   = justOneMatcher;
+    justOnePat->pat.clean   = justOneCleaner;
+    justOnePat->pat.binding = NULL;
+    justOnePat->pat.filter  = NULL;
+    justOnePat->wrapped     = ss_refer( pattern );
+    justOnePat->scoped      = ss_binds( pattern );
+    return (ss_Pattern*)justOnePat;
+}
+
+typedef struct {
+    ss_Pattern  pat;
+    ss_Pattern* wrapped;
+    ss_Span*    span;
+    bool        scoped;
+} OneOrMorePattern;
+
+static ss_Match* oneOrMoreMatcher( ss_Context* ctx, ss_Pattern* p, size_t scope, ss_Stream* stream ) {
+    OneOrMorePattern* oneOrMorePat = (OneOrMorePattern*)p;
+    
+    if( ss_halted( ctx, stream ) )
+        return NULL;
+    
+    bool bound = oneOrMorePat->pat.binding != NULL && !ctx->bare;
+    if( oneOrMorePat->span && !bound )
+        return spanMatcher( ctx, oneOrMorePat->span, 1, SIZE_MAX, stream );
+    
+    ss_Match* match = repeatMatcher( ctx, oneOrMorePat->wrapped, oneOrMorePat->scoped, bound, 1, SIZE_MAX, stream );
+    if( match && bound && scope )
+        logCapture( ctx, oneOrMorePat->pat.binding, scope, 0 );
+    return match;
+}
+
+static void oneOrMoreCleaner( ss_Context* ctx, ss_Pattern* pat ) {
+    OneOrMorePattern* oneOrMorePat = (OneOrMorePattern*)pat;
+    ss_release( oneOrMorePat->wrapped );
+    ss_dealloc( oneOrMorePat->span );
+}
+
+static ss_Pattern* ss_oneOrMorePattern( ss_Context* ctx, ss_Pattern* pattern ) {
+    OneOrMorePattern* oneOrMorePat = ss_alloc( ctx, sizeof(OneOrMorePattern), TYPE_PATTERN );
+    if( !oneOrMorePat ) {
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        return NULL;
+    }
+    oneOrMorePat->pat.kind    = KIND_ONE_OR_MORE;
+    oneOrMorePat->pat.depth   = pattern->depth + 1;
+    oneOrMorePat->pat.match   = oneOrMoreMatcher;
+    oneOrMorePat->pat.clean   = oneOrMoreCleaner;
+    oneOrMorePat->pat.binding = NULL;
+    oneOrMorePat->pat.filter  = NULL;
+    oneOrMorePat->wrapped     = ss_refer( pattern );
+    oneOrMorePat->span        = ss_spanOf( ctx, pattern );
+    oneOrMorePat->scoped      = ss_binds( pattern );
+    return (ss_Pattern*)oneOrMorePat;
+}
+
+
+/* A group with an explicit repetition count, `(...)#min..max`.  Copies
+   are matched by repeatMatcher() rather than unrolled into the tree,
+   and only get a scope of their own if the body binds anything. */
+typedef struct {
+    ss_Pattern  pat;
+    ss_Pattern* wrapped;
+    ss_Span*    span;
+    size_t      min;
+    size_t      max;
+    bool        scoped;
+} CountPattern;
+
+static ss_Match* countMatcher( ss_Context* ctx, ss_Pattern* p, size_t scope, ss_Stream* stream ) {
+    CountPattern* countPat = (CountPattern*)p;
+    
+    if( ss_halted( ctx, stream ) )
+        return NULL;
+    
+    bool bound = countPat->pat.binding != NULL && !ctx->bare;
+    if( countPat->span && !bound )
+        return spanMatcher( ctx, countPat->span, countPat->min, countPat->max, stream );
+    
+    ss_Match* match = repeatMatcher( ctx, countPat->wrapped, countPat->scoped, bound, countPat->min, countPat->max, stream );
+    if( match && bound && scope )
+        logCapture( ctx, countPat->pat.binding, scope, 0 );
+    return match;
+}
+
+static void countCleaner( ss_Context* ctx, ss_Pattern* pat ) {
+    CountPattern* countPat = (CountPattern*)pat;
+    ss_release( countPat->wrapped );
+    ss_dealloc( countPat->span );
+}
+
+static ss_Pattern* ss_countPattern( ss_Context* ctx, ss_Pattern* pattern, size_t min, size_t max ) {
+    CountPattern* countPat = ss_alloc( ctx, sizeof(CountPattern), TYPE_PATTERN );
+    if( !countPat ) {
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        return NULL;
+    }
+    countPat->pat.kind    = KIND_COUNT;
+    countPat->pat.depth   = pattern->depth + 1;
+    countPat->pat.match   = countMatcher;
+    countPat->pat.clean   = countCleaner;
+    countPat->pat.binding = NULL;
+    countPat->pat.filter  = NULL;
+    countPat->wrapped     = ss_refer( pattern );
+    countPat->span        = ss_spanOf( ctx, pattern );
+    countPat->min         = min;
+    countPat->max         = max;
+    countPat->scoped      = ss_binds( pattern );
+    return (ss_Pattern*)countPat;
+}
+
+
+typedef struct {
+    ss_Pattern  pat;
+    size_t      len;
+    long        str[];
+} LiteralPattern;
+
+static ss_Match* literalMatcher( ss_Context* ctx, ss_Pattern* p, size_t scope, ss_Stream* stream ) {
+    LiteralPattern* literalPat = (LiteralPattern*)p;
+    
+    if( ss_halted( ctx, stream ) )
+        return NULL;
+    
+    char const* loc = stream->loc;
+    for( unsigned i = 0 ; i < literalPat->len ; i++ ) {
+        if( literalPat->str[i] != stream->read( ctx, stream ) )
+            return NULL;
+    }
+    char const* end = stream->loc;
+    
+    ss_Match* match = newMatch( ctx, 0, loc, end );
+    if( match && literalPat->pat.binding && scope )
+        logCapture( ctx, literalPat->pat.binding, scope, 0 );
+    return match;
+}
+
+static ss_Pattern* ss_literalPattern( ss_Context* ctx, long const* str, size_t len ) {
+    LiteralPattern* literalPat = ss_alloc( ctx, sizeof(LiteralPattern) + sizeof(long)*len, TYPE_PATTERN );
+    if( !literalPat ) {
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        return NULL;
+    }
+    literalPat->pat.kind    = KIND_LITERAL;
+    literalPat->pat.depth   = 1;
+    literalPat->pat.match   = literalMatcher;
+    literalPat->pat.clean   = NULL;
+    literalPat->pat.binding = NULL;
+    literalPat->pat.filter  = NULL;
+    memcpy( literalPat->str, str, sizeof(long)*len );
+    literalPat->len = len;
+    return (ss_Pattern*)literalPat;
+}
+
+
+/****************************** Named Patterns ********************************/
+
+/* A set of symbols.  Those below 256 are kept in a bitmap, anything
+   above is either all in the class (`wide`) or found by a binary search
+   over a sorted table of disjoint inclusive ranges. */
+typedef struct {
+    ss_Pattern pat;
+    bool       wide;
+    uint32_t   bits[8];
+    size_t     nranges;
+    long       ranges[];
+} ClassPattern;
+
+static bool inClass( ClassPattern const* classPat, long chr ) {
+    if( chr < 0 )
+        return false;
+    if( chr > 255 )
+        return classPat->wide || inRanges( classPat->ranges, classPat->nranges, chr );
+    return ss_bitGet( classPat->bits, chr );
+}
+
+static ss_Match* classMatcher( ss_Context* ctx, ss_Pattern* p, size_t scope, ss_Stream* stream ) {
+    ClassPattern* classPat = (ClassPattern*)p;
+    
+    if( ss_halted( ctx, stream ) )
+        return NULL;
     
     char const* loc = stream->loc;
+    long        chr = stream->read( ctx, stream );
+    char const* end = stream->loc;
+    if( !inClass( classPat, chr ) )
+        return NULL;
     
-    ss_Stream   saved = *stream;
-    ss_Pattern* pat   = notNextPat->wrapped;
-    ss_Match*   match = pat->match( pat, NULL, stream );
+    ss_Match* match = newMatch( ctx, 0, loc, end );
+    if( match && classPat->pat.binding && scope )
+        logCapture( ctx, classPat->pat.binding, scope, 0 );
+    return match;
+}
+
+static ClassPattern* classAlloc( ss_Context* ctx, size_t nranges ) {
+    ClassPattern* classPat = ss_alloc( ctx, sizeof(ClassPattern) + sizeof(long)*2*nranges, TYPE_PATTERN );
+    if( !classPat ) {
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        return NULL;
+    }
+    classPat->pat.kind    = KIND_CLASS;
+    classPat->pat.depth   = 1;
+    classPat->pat.match   = classMatcher;
+    classPat->pat.clean   = NULL;
+    classPat->pat.binding = NULL;
+    classPat->pat.filter  = NULL;
+    classPat->wide        = false;
+    classPat->nranges     = nranges;
+    memset( classPat->bits, 0, sizeof(classPat->bits) );
+    return classPat;
+}
+
+/* Character classes are tabulated from the given test over the byte
+   range when created, symbols above that are either all in the class
+   (`wide`) or none are. */
+static ss_Pattern* ss_classPattern( ss_Context* ctx, int (*test)( int ch ), bool wide ) {
+    ClassPattern* classPat = classAlloc( ctx, 0 );
+    if( !classPat )
+        return NULL;
+    classPat->wide = wide;
+    for( int ch = 0 ; ch < 256 ; ch++ ) {
+        if( test( ch ) )
+            ss_bitSet( classPat->bits, ch );
+    }
+    return (ss_Pattern*)classPat;
+}
+
+/* The symbols from `lo` to `hi` inclusive, as written `'a'..'z'`. */
+static ss_Pattern* ss_rangePattern( ss_Context* ctx, long lo, long hi ) {
+    ClassPattern* classPat = classAlloc( ctx, hi > 255 ? 1 : 0 );
+    if( !classPat )
+        return NULL;
+    for( long ch = lo ; ch <= hi && ch < 256 ; ch++ )
+        ss_bitSet( classPat->bits, ch );
+    if( hi > 255 ) {
+        classPat->ranges[0] = lo > 256 ? lo : 256;
+        classPat->ranges[1] = hi;
+    }
+    return (ss_Pattern*)classPat;
+}
+
+static int compareRanges( void const* a, void const* b ) {
+    long const* ra = a;
+    long const* rb = b;
+    return ( ra[0] > rb[0] ) - ( ra[0] < rb[0] );
+}
+
+/* Alternatives that each match a single symbol, like `( 'a'..'z' | '_' )`,
+   can be tried in any order, so the alternation is folded into a single
+   class.  Wide ranges are sorted and merged so they can be searched. */
+static ss_Pattern* ss_unionPattern( ss_Context* ctx, ss_Pattern** alts, size_t count ) {
+    size_t total = 0;
+    for( size_t i = 0 ; i < count ; i++ ) {
+        ss_Pattern* alt = ss_symbolsOf( alts[i] );
+        if( alt->kind == KIND_CLASS )
+            total += ((ClassPattern*)alt)->nranges;
+        else
+        if( ss_symbolOf( alt ) > 255 )
+            total++;
+    }
     
-    *stream = saved;
+    long* ranges = ss_malloc( ctx->heap, sizeof(long)*2*( total ? total : 1 ) );
+    if( !ranges ) {
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        return NULL;
+    }
     
-    if( match ) {
-        ss_release( match );
+    uint32_t bits[8] = { 0 };
+    bool     wide    = false;
+    size_t   top     = 0;
+    for( size_t i = 0 ; i < count ; i++ ) {
+        ss_Pattern* alt = ss_symbolsOf( alts[i] );
+        if( alt->kind == KIND_CLASS ) {
+            ClassPattern* classPat = (ClassPattern*)alt;
+            for( int j = 0 ; j < 8 ; j++ )
+                bits[j] |= classPat->bits[j];
+            wide |= classPat->wide;
+            memcpy( ranges + 2*top, classPat->ranges, sizeof(long)*2*classPat->nranges );
+            top += classPat->nranges;
+            continue;
+        }
+        
+        long chr = ss_symbolOf( alt );
+        if( chr > 255 ) {
+            ranges[2*top]     = chr;
+            ranges[2*top + 1] = chr;
+            top++;
+        }
+        else
+        if( chr >= 0 ) {
+            ss_bitSet( bits, chr );
+        }
+    }
+    
+    size_t merged = 0;
+    if( !wide && top ) {
+        qsort( ranges, top, sizeof(long)*2, compareRanges );
+        for( size_t i = 1 ; i < top ; i++ ) {
+            if( ranges[2*i] <= ranges[2*merged + 1] + 1 ) {
+                if( ranges[2*i + 1] > ranges[2*merged + 1] )
+                    ranges[2*merged + 1] = ranges[2*i + 1];
+                continue;
+            }
+            merged++;
+            ranges[2*merged]     = ranges[2*i];
+            ranges[2*merged + 1] = ranges[2*i + 1];
+        }
+        merged++;
+    }
+    
+    ClassPattern* classPat = classAlloc( ctx, merged );
+    if( classPat ) {
+        memcpy( classPat->bits, bits, sizeof(bits) );
+        memcpy( classPat->ranges, ranges, sizeof(long)*2*merged );
+        classPat->wide = wide;
+    }
+    ss_dealloc( ranges );
+    return (ss_Pattern*)classPat;
+}
+
+static int isany( int ch ) {
+    return 1;
+}
+
+static void ss_prelude( ss_Context* ctx ) {
+    static struct {
+        char const* name;
+        int       (*test)( int ch );
+        bool        wide;
+    } const classes[] = {
+        { "char",  isany,   true  },
+        { "digit", isdigit, false },
+        { "alpha", isalpha, false },
+        { "alnum", isalnum, false },
+        { "blank", isblank, false },
+        { "space", isspace, false },
+        { "upper", isupper, false },
+        { "lower", islower, false }
+    };
+    
+    for( size_t i = 0 ; i < sizeof(classes)/sizeof(*classes) ; i++ ) {
+        ss_Pattern* pat = ss_classPattern( ctx, classes[i].test, classes[i].wide );
+        if( !pat )
+            return;
+        ss_mapPut( ctx, ctx->patterns, classes[i].name, pat );
+        ss_release( pat );
+    }
+    
+    ss_mapCommit( ctx, ctx->patterns );
+}
+
+
+/****************************** Pattern Analysis ******************************/
+
+static void firstAll( ss_First* first ) {
+    memset( first->bits, 0xFF, sizeof(first->bits) );
+    first->wide  = true;
+    first->empty = true;
+}
+
+static void firstUnion( ss_First* into, ss_First const* from ) {
+    for( int i = 0 ; i < 8 ; i++ )
+        into->bits[i] |= from->bits[i];
+    into->wide |= from->wide;
+}
+
+/* Computes a (conservative) first set for a pattern.  Lookaheads are
+   treated as empty since they don't consume, which can only ever make
+   the set larger than necessary, never smaller. */
+static void ss_first( ss_Pattern* pat, ss_First* first ) {
+    memset( first, 0, sizeof(ss_First) );
+    
+    switch( pat->kind ) {
+        case KIND_ALL_OF: {
+            AllOfPattern* allOfPat = (AllOfPattern*)pat;
+            first->empty = true;
+            for( size_t i = 0 ; i < allOfPat->count ; i++ ) {
+                ss_First sub;
+                ss_first( allOfPat->patterns[i], &sub );
+                firstUnion( first, &sub );
+                if( !sub.empty ) {
+                    first->empty = false;
+                    break;
+                }
+            }
+        } break;
+        case KIND_ONE_OF: {
+            OneOfPattern* oneOfPat = (OneOfPattern*)pat;
+            for( size_t i = 0 ; i < oneOfPat->count ; i++ ) {
+                ss_First sub;
+                ss_first( oneOfPat->alts[i], &sub );
+                firstUnion( first, &sub );
+                first->empty |= sub.empty;
+            }
+        } break;
+        case KIND_HAS_NEXT:
+        case KIND_NOT_NEXT:
+            first->empty = true;
+        break;
+        case KIND_ZERO_OR_ONE:
+            ss_first( ((ZeroOrOnePattern*)pat)->wrapped, first );
+            first->empty = true;
+        break;
+        case KIND_ZERO_OR_MORE:
+            ss_first( ((ZeroOrMorePattern*)pat)->wrapped, first );
+            first->empty = true;
+        break;
+        case KIND_JUST_ONE:
+            ss_first( ((JustOnePattern*)pat)->wrapped, first );
+        break;
+        case KIND_ONE_OR_MORE:
+            ss_first( ((OneOrMorePattern*)pat)->wrapped, first );
+        break;
+        case KIND_COUNT:
+            ss_first( ((CountPattern*)pat)->wrapped, first );
+            if( ((CountPattern*)pat)->min == 0 )
+                first->empty = true;
+        break;
+        case KIND_LITERAL: {
+            LiteralPattern* literalPat = (LiteralPattern*)pat;
+            if( literalPat->len == 0 )
+                first->empty = true;
+            else
+            if( literalPat->str[0] > 255 )
+                first->wide = true;
+            else
+            if( literalPat->str[0] >= 0 )
+                ss_bitSet( first->bits, literalPat->str[0] );
+        } break;
+        case KIND_CLASS: {
+            ClassPattern* classPat = (ClassPattern*)pat;
+            memcpy( first->bits, classPat->bits, sizeof(first->bits) );
+            first->wide = classPat->wide || classPat->nranges;
+        } break;
+        default:
+            firstAll( first );
+        break;
+    }
+}
+
+static void byteSetInit( ss_ByteSet* set, uint32_t const* bits, unsigned limit ) {
+    memset( set, 0, sizeof(ss_ByteSet) );
+    set->stop = -1;
+    
+    unsigned ch   = 0;
+    unsigned outs = 0;
+    while( ch <= limit ) {
+        if( !ss_bitGet( bits, ch ) ) {
+            set->stop = (int)ch;
+            outs++;
+            ch++;
+            continue;
+        }
+        
+        unsigned lo = ch;
+        while( ch <= limit && ss_bitGet( bits, ch ) ) {
+            ss_bitSet( set->bits, ch );
+            ch++;
+        }
+        
+        if( set->nranges < SPAN_RANGES ) {
+            set->lo[set->nranges] = (unsigned char)lo;
+            set->hi[set->nranges] = (unsigned char)( ch - 1 );
+        }
+        set->nranges++;
+    }
+    if( set->nranges > SPAN_RANGES )
+        set->nranges = 0;
+    if( outs != 1 || limit != 255 )
+        set->stop = -1;
+    set->kernel = spanKernel();
+}
+
+/* Peels off unbound groups with a single alternative and a single
+   element, which don't change what the grouped pattern matches. */
+static ss_Pattern* unwrapGroup( ss_Pattern* pat ) {
+    while( !pat->binding ) {
+        if( pat->kind == KIND_ONE_OF ) {
+            OneOfPattern* oneOfPat = (OneOfPattern*)pat;
+            if( oneOfPat->count != 1 )
+                break;
+            pat = oneOfPat->alts[0];
+        }
+        else
+        if( pat->kind == KIND_ALL_OF ) {
+            AllOfPattern* allOfPat = (AllOfPattern*)pat;
+            if( allOfPat->count != 1 )
+                break;
+            pat = allOfPat->patterns[0];
+        }
+        else
+        if( pat->kind == KIND_JUST_ONE ) {
+            pat = ((JustOnePattern*)pat)->wrapped;
+        }
+        else {
+            break;
+        }
+    }
+    return pat;
+}
+
+/* Adds the symbols matched by a pattern to a set, if the pattern is an
+   unbound class or single symbol literal that always consumes exactly
+   one symbol.  Classes with ranges of wide symbols are only accepted if
+   the caller can borrow them through `ranged`. */
+static bool symbolSet( ss_Pattern* pat, uint32_t* bits, bool* wide, ClassPattern const** ranged ) {
+    pat = ss_symbolsOf( pat );
+    if( !pat )
+        return false;
+    
+    if( pat->kind == KIND_CLASS ) {
+        ClassPattern* classPat = (ClassPattern*)pat;
+        if( classPat->nranges ) {
+            if( !ranged )
+                return false;
+            *ranged = classPat;
+        }
+        for( int i = 0 ; i < 8 ; i++ )
+            bits[i] |= classPat->bits[i];
+        *wide |= classPat->wide;
+        return true;
+    }
+    
+    long chr = ss_symbolOf( pat );
+    if( chr > 255 )
+        return false;
+    ss_bitSet( bits, chr );
+    return true;
+}
+
+/* Finds the character class repeated by a repetition's body, if the
+   body consumes a single symbol from an unbound class each time.  This
+   covers plain classes like `{ digit }` and classes guarded by negative
+   lookaheads like `{ ~'"' char }`, where single symbol lookaheads are
+   taken out of the class and one longer literal lookahead can become
+   the span's terminator.  The caller owns the returned span.  Failing
+   to allocate one isn't an error since the pattern works just as well
+   without. */
+static ss_Span* ss_spanOf( ss_Context* ctx, ss_Pattern* pat ) {
+    uint32_t bits[8]  = { 0 };
+    bool     wide     = false;
+    uint32_t outs[8]  = { 0 };
+    bool     wideOuts = false;
+    
+    LiteralPattern*     stop   = NULL;
+    ClassPattern const* ranged = NULL;
+    
+    pat = unwrapGroup( pat );
+    if( !symbolSet( pat, bits, &wide, &ranged ) ) {
+        if( pat->kind != KIND_ALL_OF || pat->binding )
+            return NULL;
+        
+        AllOfPattern* allOfPat = (AllOfPattern*)pat;
+        if( allOfPat->count == 0 )
+            return NULL;
+        
+        size_t last = allOfPat->count - 1;
+        for( size_t i = 0 ; i < last ; i++ ) {
+            ss_Pattern* sub = allOfPat->patterns[i];
+            if( sub->kind != KIND_NOT_NEXT )
+                return NULL;
+            
+            ss_Pattern* ahead = ((NotNextPattern*)sub)->wrapped;
+            if( symbolSet( ahead, outs, &wideOuts, NULL ) )
+                continue;
+            
+            ahead = unwrapGroup( ahead );
+            if( stop || ahead->binding || ahead->kind != KIND_LITERAL )
+                return NULL;
+            stop = (LiteralPattern*)ahead;
+            if( stop->len == 0 )
+                return NULL;
+        }
+        if( !symbolSet( allOfPat->patterns[last], bits, &wide, &ranged ) )
+            return NULL;
+        
+        for( int i = 0 ; i < 8 ; i++ )
+            bits[i] &= ~outs[i];
+        wide &= !wideOuts;
+        if( wideOuts )
+            ranged = NULL;
+    }
+    
+    size_t   stoplen = stop ? stop->len : 0;
+    ss_Span* span    = ss_malloc( ctx->heap, sizeof(ss_Span) + sizeof(long)*stoplen );
+    if( !span )
+        return NULL;
+    span->wide    = wide;
+    span->nranges = ranged ? ranged->nranges : 0;
+    span->ranges  = ranged ? ranged->ranges : NULL;
+    span->stoplen = stoplen;
+    if( stop )
+        memcpy( span->stop, stop->str, sizeof(long)*stoplen );
+    byteSetInit( &span->bytes, bits, 255 );
+    byteSetInit( &span->ascii, bits, 127 );
+    return span;
+}
+
+/* Nesting depth of the deepest pattern in a list; every constructor
+   records its own depth so ss_compile() can enforce the context's
+   limit without walking the tree again. */
+static unsigned ss_listDepth( ss_List* patterns ) {
+    unsigned depth = 0;
+    for( ss_ListNode* node = patterns->first ; node ; node = node->next ) {
+        ss_Pattern* pat = node->value;
+        if( pat->depth > depth )
+            depth = pat->depth;
+    }
+    return depth;
+}
+
+/* Whether anything in a pattern carries a binding, and so needs a scope
+   to put it in. */
+static bool ss_binds( ss_Pattern* pat ) {
+    if( pat->binding )
+        return true;
+    
+    switch( pat->kind ) {
+        case KIND_ALL_OF: {
+            AllOfPattern* allOfPat = (AllOfPattern*)pat;
+            for( size_t i = 0 ; i < allOfPat->count ; i++ ) {
+                if( ss_binds( allOfPat->patterns[i] ) )
+                    return true;
+            }
+            return false;
+        }
+        case KIND_ONE_OF: {
+            OneOfPattern* oneOfPat = (OneOfPattern*)pat;
+            for( size_t i = 0 ; i < oneOfPat->count ; i++ ) {
+                if( ss_binds( oneOfPat->alts[i] ) )
+                    return true;
+            }
+            return false;
+        }
+        case KIND_HAS_NEXT:
+            return ss_binds( ((HasNextPattern*)pat)->wrapped );
+        case KIND_NOT_NEXT:
+            return ss_binds( ((NotNextPattern*)pat)->wrapped );
+        case KIND_ZERO_OR_ONE:
+            return ss_binds( ((ZeroOrOnePattern*)pat)->wrapped );
+        case KIND_ZERO_OR_MORE:
+            return ss_binds( ((ZeroOrMorePattern*)pat)->wrapped );
+        case KIND_JUST_ONE:
+            return ss_binds( ((JustOnePattern*)pat)->wrapped );
+        case KIND_ONE_OR_MORE:
+            return ss_binds( ((OneOrMorePattern*)pat)->wrapped );
+        case KIND_COUNT:
+            return ss_binds( ((CountPattern*)pat)->wrapped );
+        default:
+            return false;
+    }
+}
+
+/* Counts the patterns that bind `name` (of `len` characters) into the
+   scope `pat` is matched in, storing the first `max` of them in
+   `sites`.  Groups match their bodies in scopes of their own, so their
+   insides aren't searched, and neither are negative lookaheads, which
+   never bind anything. */
+static size_t ss_sitesOf( ss_Pattern* pat, char const* name, size_t len, ss_Pattern** sites, size_t max ) {
+    size_t n = 0;
+    if( pat->binding && strlen( pat->binding ) == len && !memcmp( pat->binding, name, len ) ) {
+        if( max > 0 )
+            sites[0] = pat;
+        n = 1;
+    }
+    
+    ss_Pattern** subs  = NULL;
+    size_t       nsubs = 0;
+    switch( pat->kind ) {
+        case KIND_ALL_OF:
+            subs  = ((AllOfPattern*)pat)->patterns;
+            nsubs = ((AllOfPattern*)pat)->count;
+        break;
+        case KIND_ONE_OF:
+            subs  = ((OneOfPattern*)pat)->alts;
+            nsubs = ((OneOfPattern*)pat)->count;
+        break;
+        case KIND_HAS_NEXT: {
+            ss_Pattern* wrapped = ((HasNextPattern*)pat)->wrapped;
+            return n + ss_sitesOf( wrapped, name, len, sites ? sites + n : NULL, max > n ? max - n : 0 );
+        }
+        default:
+        break;
+    }
+    for( size_t i = 0 ; i < nsubs ; i++ )
+        n += ss_sitesOf( subs[i], name, len, sites ? sites + n : NULL, max > n ? max - n : 0 );
+    return n;
+}
+
+/* The pattern whose bindings end up in the scope of a pattern's match,
+   or NULL if its match has no scope of its own. */
+static ss_Pattern* ss_bodyOf( ss_Pattern* pat ) {
+    switch( pat->kind ) {
+        case KIND_ZERO_OR_ONE:
+            return ((ZeroOrOnePattern*)pat)->wrapped;
+        case KIND_ZERO_OR_MORE:
+            return ((ZeroOrMorePattern*)pat)->wrapped;
+        case KIND_JUST_ONE:
+            return ((JustOnePattern*)pat)->wrapped;
+        case KIND_ONE_OR_MORE:
+            return ((OneOrMorePattern*)pat)->wrapped;
+        case KIND_COUNT:
+            return ((CountPattern*)pat)->wrapped;
+        default:
+            return NULL;
+    }
+}
+
+/* The symbol matched by a single symbol literal, or -1. */
+static long ss_symbolOf( ss_Pattern* pat ) {
+    if( pat->kind != KIND_LITERAL )
+        return -1;
+    
+    LiteralPattern* literalPat = (LiteralPattern*)pat;
+    if( literalPat->len != 1 )
+        return -1;
+    return literalPat->str[0];
+}
+
+/* The class or single symbol literal a pattern reduces to, if it always
+   consumes exactly one symbol and binds nothing, or NULL. */
+static ss_Pattern* ss_symbolsOf( ss_Pattern* pat ) {
+    pat = unwrapGroup( pat );
+    if( pat->binding )
+        return NULL;
+    if( pat->kind == KIND_CLASS || ss_symbolOf( pat ) >= 0 )
+        return pat;
+    return NULL;
+}
+
+/* The symbols of the unbound literal a pattern reduces to, or NULL. */
+static long const* ss_stringOf( ss_Pattern* pat, size_t* len ) {
+    pat = unwrapGroup( pat );
+    if( pat->binding || pat->kind != KIND_LITERAL )
         return NULL;
+    
+    LiteralPattern* literalPat = (LiteralPattern*)pat;
+    *len = literalPat->len;
+    return literalPat->str;
+}
+
+/* Encodes a symbol as it appears in input of the given format, returning
+   the number of bytes, or 0 if the symbol can't appear in such input. */
+static size_t encodeSymbol( ss_Format fmt, long sym, unsigned char* out ) {
+    if( sym < 0 )
+        return 0;
+    if( fmt == ss_BYTES ) {
+        if( sym > 255 )
+            return 0;
+        out[0] = (unsigned char)sym;
+        return 1;
+    }
+    
+    if( sym < 0x80 ) {
+        out[0] = (unsigned char)sym;
+        return 1;
+    }
+    if( sym < 0x800 ) {
+        out[0] = (unsigned char)( 0xC0 | sym >> 6 );
+        out[1] = (unsigned char)( 0x80 | ( sym & 0x3F ) );
+        return 2;
+    }
+    if( sym < 0x10000 ) {
+        out[0] = (unsigned char)( 0xE0 | sym >> 12 );
+        out[1] = (unsigned char)( 0x80 | ( sym >> 6 & 0x3F ) );
+        out[2] = (unsigned char)( 0x80 | ( sym & 0x3F ) );
+        return 3;
+    }
+    if( sym <= ss_CODE_MAX ) {
+        out[0] = (unsigned char)( 0xF0 | sym >> 18 );
+        out[1] = (unsigned char)( 0x80 | ( sym >> 12 & 0x3F ) );
+        out[2] = (unsigned char)( 0x80 | ( sym >> 6 & 0x3F ) );
+        out[3] = (unsigned char)( 0x80 | ( sym & 0x3F ) );
+        return 4;
+    }
+    return 0;
+}
+
+static size_t addLength( size_t a, size_t b ) {
+    return a > SIZE_MAX - b ? SIZE_MAX : a + b;
+}
+
+static size_t mulLength( size_t a, size_t n ) {
+    if( a == 0 || n == 0 )
+        return 0;
+    return a > SIZE_MAX/n ? SIZE_MAX : a*n;
+}
+
+/* The fewest and most bytes a match of the pattern can consume in input
+   of the given format, with SIZE_MAX standing in for no upper bound.
+   Symbols that can't be encoded in the format are counted as one byte,
+   which doesn't matter since nothing depending on them can match. */
+static void ss_lengthOf( ss_Pattern* pat, ss_Format fmt, size_t* min, size_t* max ) {
+    unsigned char code[4];
+    switch( pat->kind ) {
+        case KIND_ALL_OF: {
+            AllOfPattern* allOfPat = (AllOfPattern*)pat;
+            *min = 0;
+            *max = 0;
+            for( size_t i = 0 ; i < allOfPat->count ; i++ ) {
+                size_t subMin, subMax;
+                ss_lengthOf( allOfPat->patterns[i], fmt, &subMin, &subMax );
+                *min = addLength( *min, subMin );
+                *max = addLength( *max, subMax );
+            }
+        } break;
+        case KIND_ONE_OF: {
+            OneOfPattern* oneOfPat = (OneOfPattern*)pat;
+            *min = oneOfPat->count ? SIZE_MAX : 0;
+            *max = 0;
+            for( size_t i = 0 ; i < oneOfPat->count ; i++ ) {
+                size_t subMin, subMax;
+                ss_lengthOf( oneOfPat->alts[i], fmt, &subMin, &subMax );
+                if( subMin < *min )
+                    *min = subMin;
+                if( subMax > *max )
+                    *max = subMax;
+            }
+        } break;
+        case KIND_HAS_NEXT:
+        case KIND_NOT_NEXT:
+            *min = 0;
+            *max = 0;
+        break;
+        case KIND_ZERO_OR_ONE:
+            ss_lengthOf( ((ZeroOrOnePattern*)pat)->wrapped, fmt, min, max );
+            *min = 0;
+        break;
+        case KIND_ZERO_OR_MORE:
+            ss_lengthOf( ((ZeroOrMorePattern*)pat)->wrapped, fmt, min, max );
+            *min = 0;
+            *max = mulLength( *max, SIZE_MAX );
+        break;
+        case KIND_JUST_ONE:
+            ss_lengthOf( ((JustOnePattern*)pat)->wrapped, fmt, min, max );
+        break;
+        case KIND_ONE_OR_MORE:
+            ss_lengthOf( ((OneOrMorePattern*)pat)->wrapped, fmt, min, max );
+            *max = mulLength( *max, SIZE_MAX );
+        break;
+        case KIND_COUNT: {
+            CountPattern* countPat = (CountPattern*)pat;
+            ss_lengthOf( countPat->wrapped, fmt, min, max );
+            *min = mulLength( *min, countPat->min );
+            *max = mulLength( *max, countPat->max );
+        } break;
+        case KIND_LITERAL: {
+            LiteralPattern* literalPat = (LiteralPattern*)pat;
+            *min = 0;
+            for( size_t i = 0 ; i < literalPat->len ; i++ ) {
+                size_t n = encodeSymbol( fmt, literalPat->str[i], code );
+                *min = addLength( *min, n ? n : 1 );
+            }
+            *max = *min;
+        } break;
+        case KIND_CLASS: {
+            ClassPattern* classPat = (ClassPattern*)pat;
+            *min = 1;
+            *max = 1;
+            if( fmt == ss_BYTES )
+                break;
+            
+            bool low  = false;
+            bool high = false;
+            for( unsigned ch = 0 ; ch < 256 ; ch++ ) {
+                if( ss_bitGet( classPat->bits, ch ) ) {
+                    if( ch < 0x80 )
+                        low = true;
+                    else
+                        high = true;
+                }
+            }
+            if( !low && ( high || classPat->wide ) )
+                *min = 2;
+            else
+            if( !low && classPat->nranges )
+                *min = encodeSymbol( fmt, classPat->ranges[0], code );
+            
+            if( classPat->wide )
+                *max = 4;
+            else
+            if( classPat->nranges )
+                *max = encodeSymbol( fmt, classPat->ranges[2*classPat->nranges - 1], code );
+            else
+            if( high )
+                *max = 2;
+            
+            if( *min == 0 || *max == 0 ) {
+                *min = 1;
+                *max = 4;
+            }
+        } break;
+        default:
+            *min = 0;
+            *max = SIZE_MAX;
+        break;
+    }
+}
+
+/* Appends bytes to a suffix, dropping any that no longer fit from the
+   front, in which case the suffix is no longer the whole match. */
+static void suffixAppend( char* tail, size_t* len, bool* whole, char const* bytes, size_t n ) {
+    if( n > NEED_WIDTH ) {
+        bytes += n - NEED_WIDTH;
+        n      = NEED_WIDTH;
+        *whole = false;
+    }
+    if( *len + n > NEED_WIDTH ) {
+        size_t drop = *len + n - NEED_WIDTH;
+        memmove( tail, tail + drop, *len - drop );
+        *len  -= drop;
+        *whole = false;
+    }
+    memcpy( tail + *len, bytes, n );
+    *len += n;
+}
+
+/* Collects up to NEED_WIDTH bytes every match of a pattern ends with,
+   returning true if they make up the whole of every match. */
+static bool suffixOf( ss_Pattern* pat, ss_Format fmt, char* tail, size_t* len ) {
+    *len = 0;
+    switch( pat->kind ) {
+        case KIND_ALL_OF: {
+            AllOfPattern* allOfPat = (AllOfPattern*)pat;
+            bool          whole    = true;
+            for( size_t i = 0 ; i < allOfPat->count ; i++ ) {
+                char   sub[NEED_WIDTH];
+                size_t subLen;
+                if( suffixOf( allOfPat->patterns[i], fmt, sub, &subLen ) ) {
+                    suffixAppend( tail, len, &whole, sub, subLen );
+                }
+                else {
+                    memcpy( tail, sub, subLen );
+                    *len  = subLen;
+                    whole = false;
+                }
+            }
+            return whole;
+        }
+        case KIND_ONE_OF: {
+            OneOfPattern* oneOfPat = (OneOfPattern*)pat;
+            if( oneOfPat->count == 0 )
+                return false;
+            
+            bool whole = suffixOf( oneOfPat->alts[0], fmt, tail, len );
+            for( size_t i = 1 ; i < oneOfPat->count && *len > 0 ; i++ ) {
+                char   sub[NEED_WIDTH];
+                size_t subLen;
+                if( !suffixOf( oneOfPat->alts[i], fmt, sub, &subLen ) || subLen != *len )
+                    whole = false;
+                
+                size_t same = 0;
+                while( same < *len && same < subLen && tail[*len - same - 1] == sub[subLen - same - 1] )
+                    same++;
+                if( same < *len ) {
+                    memmove( tail, tail + *len - same, same );
+                    *len  = same;
+                    whole = false;
+                }
+            }
+            return whole && *len > 0;
+        }
+        case KIND_HAS_NEXT:
+        case KIND_NOT_NEXT:
+            return true;
+        case KIND_JUST_ONE:
+            return suffixOf( ((JustOnePattern*)pat)->wrapped, fmt, tail, len );
+        case KIND_ONE_OR_MORE:
+            suffixOf( ((OneOrMorePattern*)pat)->wrapped, fmt, tail, len );
+            return false;
+        case KIND_COUNT: {
+            CountPattern* countPat = (CountPattern*)pat;
+            if( countPat->min == 0 )
+                return false;
+            bool whole = suffixOf( countPat->wrapped, fmt, tail, len );
+            return whole && countPat->max == 1;
+        }
+        case KIND_LITERAL: {
+            LiteralPattern* literalPat = (LiteralPattern*)pat;
+            bool            whole      = true;
+            for( size_t i = 0 ; i < literalPat->len ; i++ ) {
+                unsigned char code[4];
+                size_t        n = encodeSymbol( fmt, literalPat->str[i], code );
+                if( n == 0 ) {
+                    *len = 0;
+                    return false;
+                }
+                suffixAppend( tail, len, &whole, (char const*)code, n );
+            }
+            return whole;
+        }
+        default:
+            return false;
+    }
+}
+
+/* Works out the bounds on what the parts of a sequence after each part
+   can consume, for allOfWalk().  Sequences of one part gain nothing from
+   them.  Since they're only an optimization, failing to allocate them
+   just leaves them out. */
+static void restOf( ss_Context* ctx, ss_Pattern* pat, ss_Format fmt, ss_Filter* filter ) {
+    if( pat->kind != KIND_ALL_OF )
+        return;
+    
+    AllOfPattern* allOfPat = (AllOfPattern*)pat;
+    size_t        steps    = allOfPat->count;
+    if( steps < 2 )
+        return;
+    
+    size_t* rest = ss_malloc( ctx->heap, sizeof(size_t)*2*steps );
+    if( !rest )
+        return;
+    
+    size_t i = 0;
+    for( ; i < steps ; i++ )
+        ss_lengthOf( allOfPat->patterns[i], fmt, &rest[2*i], &rest[2*i + 1] );
+    
+    size_t min = 0;
+    size_t max = 0;
+    while( i-- > 0 ) {
+        size_t partMin = rest[2*i];
+        size_t partMax = rest[2*i + 1];
+        rest[2*i]     = min;
+        rest[2*i + 1] = max;
+        min = addLength( min, partMin );
+        max = addLength( max, partMax );
+    }
+    filter->steps = steps;
+    filter->rest  = rest;
+}
+
+/* The leading bytes of the symbols in a first set.  Character input
+   starts symbols above 127 with a lead byte, so those are added in bulk. */
+static void firstBytes( ss_First const* first, ss_Format fmt, uint32_t* bits ) {
+    memset( bits, 0, sizeof(uint32_t)*8 );
+    if( fmt == ss_BYTES ) {
+        memcpy( bits, first->bits, sizeof(uint32_t)*8 );
+        return;
+    }
+    
+    for( unsigned ch = 0 ; ch < 256 ; ch++ ) {
+        if( !ss_bitGet( first->bits, ch ) )
+            continue;
+        unsigned char lead[4];
+        encodeSymbol( fmt, (long)ch, lead );
+        ss_bitSet( bits, lead[0] );
+    }
+    if( first->wide ) {
+        for( unsigned lead = 0xC4 ; lead <= 0xF4 ; lead++ )
+            ss_bitSet( bits, lead );
+    }
+}
+
+/* Collects the literals one of which every match of a pattern has to
+   start with, failing if the pattern might start some other way or if
+   there are more than TEDDY_LITERALS of them.  Lookaheads and empty
+   literals ahead of the first literal are passed over. */
+static bool prefixLiterals( ss_Pattern* pat, LiteralPattern** lits, size_t* count ) {
+    switch( pat->kind ) {
+        case KIND_LITERAL: {
+            LiteralPattern* literalPat = (LiteralPattern*)pat;
+            if( literalPat->len == 0 || *count == TEDDY_LITERALS )
+                return false;
+            lits[(*count)++] = literalPat;
+            return true;
+        }
+        case KIND_ALL_OF: {
+            AllOfPattern* allOfPat = (AllOfPattern*)pat;
+            for( size_t i = 0 ; i < allOfPat->count ; i++ ) {
+                ss_Pattern* sub = allOfPat->patterns[i];
+                if( sub->kind == KIND_HAS_NEXT || sub->kind == KIND_NOT_NEXT )
+                    continue;
+                if( sub->kind == KIND_LITERAL && ((LiteralPattern*)sub)->len == 0 )
+                    continue;
+                return prefixLiterals( sub, lits, count );
+            }
+            return false;
+        }
+        case KIND_ONE_OF: {
+            OneOfPattern* oneOfPat = (OneOfPattern*)pat;
+            for( size_t i = 0 ; i < oneOfPat->count ; i++ ) {
+                if( !prefixLiterals( oneOfPat->alts[i], lits, count ) )
+                    return false;
+            }
+            return oneOfPat->count > 0;
+        }
+        case KIND_JUST_ONE:
+            return prefixLiterals( ((JustOnePattern*)pat)->wrapped, lits, count );
+        case KIND_ONE_OR_MORE:
+            return prefixLiterals( ((OneOrMorePattern*)pat)->wrapped, lits, count );
+        case KIND_COUNT:
+            if( ((CountPattern*)pat)->min == 0 )
+                return false;
+            return prefixLiterals( ((CountPattern*)pat)->wrapped, lits, count );
+        default:
+            return false;
+    }
+}
+
+/* Finds the longest literal every match of a pattern has to contain.
+   Alternations only get one if all their alternatives agree on it. */
+static LiteralPattern* requiredLiteral( ss_Pattern* pat ) {
+    switch( pat->kind ) {
+        case KIND_LITERAL:
+            if( ((LiteralPattern*)pat)->len == 0 )
+                return NULL;
+            return (LiteralPattern*)pat;
+        case KIND_ALL_OF: {
+            AllOfPattern*   allOfPat = (AllOfPattern*)pat;
+            LiteralPattern* best     = NULL;
+            for( size_t i = 0 ; i < allOfPat->count ; i++ ) {
+                ss_Pattern* sub = allOfPat->patterns[i];
+                if( sub->kind == KIND_HAS_NEXT || sub->kind == KIND_NOT_NEXT )
+                    continue;
+                LiteralPattern* lit = requiredLiteral( sub );
+                if( lit && ( !best || lit->len > best->len ) )
+                    best = lit;
+            }
+            return best;
+        }
+        case KIND_ONE_OF: {
+            OneOfPattern*   oneOfPat = (OneOfPattern*)pat;
+            LiteralPattern* common   = NULL;
+            for( size_t i = 0 ; i < oneOfPat->count ; i++ ) {
+                LiteralPattern* lit = requiredLiteral( oneOfPat->alts[i] );
+                if( !lit )
+                    return NULL;
+                if( common && ( lit->len != common->len || memcmp( lit->str, common->str, lit->len*sizeof(long) ) ) )
+                    return NULL;
+                common = lit;
+            }
+            return common;
+        }
+        case KIND_JUST_ONE:
+            return requiredLiteral( ((JustOnePattern*)pat)->wrapped );
+        case KIND_ONE_OR_MORE:
+            return requiredLiteral( ((OneOrMorePattern*)pat)->wrapped );
+        case KIND_COUNT:
+            if( ((CountPattern*)pat)->min == 0 )
+                return NULL;
+            return requiredLiteral( ((CountPattern*)pat)->wrapped );
+        default:
+            return NULL;
+    }
+}
+
+/* Works out how ss_find() and ss_match() can pass over well formed input
+   of the given format.  Patterns that can match without consuming
+   anything can start anywhere, and get no skip. */
+static void ss_filter( ss_Context* ctx, ss_Pattern* pat, ss_Format fmt, ss_Filter* filter ) {
+    memset( filter, 0, sizeof(ss_Filter) );
+    filter->scoped = ss_binds( pat );
+    ss_lengthOf( pat, fmt, &filter->shortest, &filter->longest );
+    suffixOf( pat, fmt, filter->ending, &filter->tail );
+    restOf( ctx, pat, fmt, filter );
+    
+    LiteralPattern* required = requiredLiteral( pat );
+    if( required ) {
+        for( size_t i = 0 ; i < required->len ; i++ ) {
+            unsigned char code[4];
+            size_t        n = encodeSymbol( fmt, required->str[i], code );
+            if( n == 0 || filter->needed + n > NEED_WIDTH )
+                break;
+            memcpy( filter->need + filter->needed, code, n );
+            filter->needed += n;
+        }
+    }
+    
+    ss_First first;
+    ss_first( pat, &first );
+    if( first.empty )
+        return;
+    
+    uint32_t bits[8];
+    firstBytes( &first, fmt, bits );
+    for( int i = 0 ; i < 8 ; i++ )
+        bits[i] = ~bits[i];
+    byteSetInit( &filter->starts, bits, 255 );
+    filter->skip = true;
+    
+    LiteralPattern* lits[TEDDY_LITERALS];
+    size_t          count = 0;
+    if( !prefixLiterals( pat, lits, &count ) || count < 2 )
+        return;
+    
+    unsigned char lead[TEDDY_LITERALS][TEDDY_WIDTH + 3];
+    size_t        width = TEDDY_WIDTH;
+    size_t        used  = 0;
+    for( size_t k = 0 ; k < count ; k++ ) {
+        size_t len = 0;
+        size_t i   = 0;
+        while( len < TEDDY_WIDTH && i < lits[k]->len ) {
+            size_t n = encodeSymbol( fmt, lits[k]->str[i++], lead[used] + len );
+            if( n == 0 )
+                break;
+            len += n;
+        }
+        if( len < TEDDY_WIDTH && i < lits[k]->len )
+            continue;
+        if( len < width )
+            width = len;
+        used++;
     }
+    if( used < 2 )
+        return;
     
-    match = ss_alloc( sizeof(ss_Match), TYPE_MATCH );
-    match->scope = NULL;
-    match->next  = NULL;
-    match->loc   = loc;
-    match->end   = loc;
-    return match;
+    for( size_t k = 0 ; k < used ; k++ ) {
+        unsigned char bucket = (unsigned char)( 1 << ( k % 8 ) );
+        for( size_t j = 0 ; j < width ; j++ ) {
+            filter->lo[j][lead[k][j] & 15] |= bucket;
+            filter->hi[j][lead[k][j] >> 4] |= bucket;
+        }
+    }
+    filter->teddy  = (unsigned)width;
+    filter->kernel = teddyKernel();
 }
 
-static void notNextCleaner( ss_Pattern* p ) {
-    NotNextPattern* notNextPat = (NotNextPattern*)p;
-    ss_release( notNextPat->wrapped );
+/******************************* Pattern Layout *******************************/
+
+/* Compiled patterns are copied into a single block, each node followed
+   by the things only it points to (its binding, tables and spans), in
+   the order matching reaches them.  Nodes with several parents, such as
+   named patterns, are copied once.  Pointers between them are redirected
+   into the block, so a match stays within it and releasing the pattern
+   frees all of it at once.  Every node keeps an object header so it can
+   be handled like any other pattern, but only the root's is released. */
+#define LAYOUT_ALIGN 16
+#define layoutRound( N ) ( ( (N) + LAYOUT_ALIGN - 1 ) & ~(size_t)( LAYOUT_ALIGN - 1 ) )
+
+typedef struct {
+    ss_Pattern* from;
+    ss_Pattern* to;
+    size_t      size;
+    size_t      at;
+} LayoutNode;
+
+/* Nodes are found by address through an open addressed table of their
+   indices (plus one, so zero is empty).  The ranges of classes are
+   entered too, since spans borrow them. */
+typedef struct {
+    LayoutNode*  nodes;
+    size_t       count;
+    size_t       cap;
+    void const** keys;
+    size_t*      slots;
+    size_t       nslots;
+    size_t       total;
+} Layout;
+
+static size_t layoutSize( ss_Pattern* pat ) {
+    switch( pat->kind ) {
+        case KIND_ALL_OF:
+            return sizeof(AllOfPattern) + sizeof(ss_Pattern*)*((AllOfPattern*)pat)->count;
+        case KIND_ONE_OF:
+            return sizeof(OneOfPattern) + sizeof(ss_Pattern*)*((OneOfPattern*)pat)->count;
+        case KIND_HAS_NEXT:
+            return sizeof(HasNextPattern);
+        case KIND_NOT_NEXT:
+            return sizeof(NotNextPattern);
+        case KIND_ZERO_OR_ONE:
+            return sizeof(ZeroOrOnePattern);
+        case KIND_ZERO_OR_MORE:
+            return sizeof(ZeroOrMorePattern);
+        case KIND_JUST_ONE:
+            return sizeof(JustOnePattern);
+        case KIND_ONE_OR_MORE:
+            return sizeof(OneOrMorePattern);
+        case KIND_COUNT:
+            return sizeof(CountPattern);
+        case KIND_LITERAL:
+            return sizeof(LiteralPattern) + sizeof(long)*((LiteralPattern*)pat)->len;
+        case KIND_CLASS:
+            return sizeof(ClassPattern) + sizeof(long)*2*((ClassPattern*)pat)->nranges;
+    }
+    assert( false );
+    return 0;
 }
 
-static ss_Pattern* ss_notNextPattern( ss_Pattern* pattern ) {
-    NotNextPattern* notNextPat = ss_alloc( sizeof(NotNextPattern), TYPE_PATTERN );
-    notNextPat->pat.match   = notNextMatcher;
-    notNextPat->pat.clean   = notNextCleaner;
-    notNextPat->pat.binding = NULL;
-    notNextPat->wrapped     = ss_refer( pattern );
-    return (ss_Pattern*)notNextPat;
+/* The slots holding a node's children, and how many there are. */
+static ss_Pattern** layoutKids( ss_Pattern* pat, size_t* count ) {
+    *count = 1;
+    switch( pat->kind ) {
+        case KIND_ALL_OF:
+            *count = ((AllOfPattern*)pat)->count;
+            return ((AllOfPattern*)pat)->patterns;
+        case KIND_ONE_OF:
+            *count = ((OneOfPattern*)pat)->count;
+            return ((OneOfPattern*)pat)->alts;
+        case KIND_HAS_NEXT:
+            return &((HasNextPattern*)pat)->wrapped;
+        case KIND_NOT_NEXT:
+            return &((NotNextPattern*)pat)->wrapped;
+        case KIND_ZERO_OR_ONE:
+            return &((ZeroOrOnePattern*)pat)->wrapped;
+        case KIND_ZERO_OR_MORE:
+            return &((ZeroOrMorePattern*)pat)->wrapped;
+        case KIND_JUST_ONE:
+            return &((JustOnePattern*)pat)->wrapped;
+        case KIND_ONE_OR_MORE:
+            return &((OneOrMorePattern*)pat)->wrapped;
+        case KIND_COUNT:
+            return &((CountPattern*)pat)->wrapped;
+        default:
+            *count = 0;
+            return NULL;
+    }
 }
 
+/* The slot holding a repetition's span, if it has one. */
+static ss_Span** layoutSpan( ss_Pattern* pat ) {
+    switch( pat->kind ) {
+        case KIND_ZERO_OR_MORE:
+            return &((ZeroOrMorePattern*)pat)->span;
+        case KIND_ONE_OR_MORE:
+            return &((OneOrMorePattern*)pat)->span;
+        case KIND_COUNT:
+            return &((CountPattern*)pat)->span;
+        default:
+            return NULL;
+    }
+}
 
-typedef struct {
-    ss_Pattern  pat;
-    ss_Pattern* wrapped;
-} ZeroOrOnePattern;
+static size_t spanSize( ss_Span const* span ) {
+    return sizeof(ss_Span) + sizeof(long)*span->stoplen;
+}
 
-static ss_Match* zeroOrOneMatcher( ss_Pattern* p, ss_Map* scope, ss_Stream* stream ) {
-    ZeroOrOnePattern* zeroOrOnePat = (ZeroOrOnePattern*)p;
-    
-    char const* loc = stream->loc;
+/* Space for what a node owns beyond its own structure. */
+static size_t layoutExtra( ss_Pattern* pat ) {
+    size_t extra = 0;
+    if( pat->binding )
+        extra += layoutRound( strlen( pat->binding ) + 1 );
     
-    ss_Stream   saved  = *stream;
-    ss_Map*     sscope = ss_mapNew();
-    ss_Pattern* pat    = zeroOrOnePat->wrapped;
-    ss_Match*   match  = pat->match( pat, sscope, stream );
-    ss_mapCommit( sscope );
-    ss_release( sscope );
+    ss_Span** span = layoutSpan( pat );
+    if( span && *span )
+        extra += layoutRound( spanSize( *span ) );
     
-    if( !match ) {
-        *stream = saved;
-        match = ss_alloc( sizeof(ss_Match), TYPE_MATCH );
-        match->scope = NULL;
-        match->next  = NULL;
-        match->loc   = loc;
-        match->end   = loc;
-    }
-    if( zeroOrOnePat->pat.binding && scope )
-        ss_mapPut( scope, zeroOrOnePat->pat.binding, match );
-    return match;
+    if( pat->kind == KIND_ONE_OF ) {
+        OneOfPattern* oneOfPat = (OneOfPattern*)pat;
+        if( oneOfPat->table ) {
+            extra += layoutRound( sizeof(unsigned)*oneOfPat->offsets[DISPATCH_SIZE] );
+            extra += layoutRound( sizeof(unsigned)*( DISPATCH_SIZE + 1 ) );
+        }
+        if( oneOfPat->trie )
+            extra += layoutRound( sizeof(TrieNode)*oneOfPat->nodes );
+    }
+    return extra;
 }
 
-static void zeroOrOneCleaner( ss_Pattern* p ) {
-    ZeroOrOnePattern* zeroOrOnePat = (ZeroOrOnePattern*)p;
-    ss_release( zeroOrOnePat->wrapped );
+static size_t layoutHash( void const* key ) {
+    return (size_t)( ( (uintptr_t)key >> 4 )*2654435761u );
 }
 
-static ss_Pattern* ss_zeroOrOnePattern( ss_Pattern* pattern ) {
-    ZeroOrOnePattern* zeroOrOnePat = ss_alloc( sizeof(ZeroOrOnePattern), TYPE_PATTERN );
-    zeroOrOnePat->pat.match   = zeroOrOneMatcher;
-    zeroOrOnePat->pat.clean   = zeroOrOneCleaner;
-    zeroOrOnePat->pat.binding = NULL;
-    zeroOrOnePat->wrapped     = ss_refer( pattern );
-    return (ss_Pattern*)zeroOrOnePat;
+static LayoutNode* layoutFind( Layout* layout, void const* key ) {
+    if( layout->nslots == 0 )
+        return NULL;
+    
+    size_t mask = layout->nslots - 1;
+    for( size_t i = layoutHash( key ) & mask ; layout->slots[i] ; i = ( i + 1 ) & mask ) {
+        if( layout->keys[i] == key )
+            return &layout->nodes[layout->slots[i] - 1];
+    }
+    return NULL;
 }
 
+static void layoutEnter( Layout* layout, void const* key, size_t index ) {
+    size_t mask = layout->nslots - 1;
+    size_t i    = layoutHash( key ) & mask;
+    while( layout->slots[i] )
+        i = ( i + 1 ) & mask;
+    layout->keys[i]  = key;
+    layout->slots[i] = index + 1;
+}
 
-typedef struct {
-    ss_Pattern  pat;
-    ss_Pattern* wrapped;
-} ZeroOrMorePattern;
+static void layoutEnterNode( Layout* layout, size_t index ) {
+    ss_Pattern* pat = layout->nodes[index].from;
+    layoutEnter( layout, pat, index );
+    if( pat->kind == KIND_CLASS && ((ClassPattern*)pat)->nranges )
+        layoutEnter( layout, ((ClassPattern*)pat)->ranges, index );
+}
 
-static ss_Match* zeroOrMoreMatcher( ss_Pattern* p, ss_Map* scope, ss_Stream* stream ) {
-    ZeroOrMorePattern* zeroOrMorePat = (ZeroOrMorePattern*)p;
+/* Keeps the table under half full, counting two keys per node. */
+static int layoutGrow( ss_Context* ctx, Layout* layout ) {
+    if( layout->count == layout->cap ) {
+        size_t      cap   = layout->cap ? layout->cap*2 : 64;
+        LayoutNode* nodes = ss_realloc( ctx->heap, layout->nodes, sizeof(LayoutNode)*cap );
+        if( !nodes ) {
+            ss_error( ctx, ss_ERR_ALLOC, NULL );
+            return -1;
+        }
+        layout->nodes = nodes;
+        layout->cap   = cap;
+    }
     
-    char const* loc = stream->loc;
+    if( ( layout->count + 1 )*4 <= layout->nslots )
+        return 0;
     
-    ss_Stream   saved  = *stream;
-    ss_Map*     sscope = ss_mapNew();
-    ss_Pattern* pat    = zeroOrMorePat->wrapped;
-    ss_Match*   first  = pat->match( pat, sscope, stream );
-    ss_Match*   last   = first;
-    ss_mapCommit( sscope );
-    ss_release( sscope );
-    if( !first ) {
-        *stream = saved;
-        ss_Match* match = ss_alloc( sizeof(ss_Match), TYPE_MATCH );
-        match->scope = NULL;
-        match->next  = NULL;
-        match->loc   = loc;
-        match->end   = loc;
-        if( zeroOrMorePat->pat.binding && scope )
-            ss_mapPut( scope, zeroOrMorePat->pat.binding, match );
-        return match;
+    size_t       nslots = layout->nslots ? layout->nslots*2 : 256;
+    void const** keys   = ss_malloc( ctx->heap, sizeof(void const*)*nslots );
+    size_t*      slots  = ss_calloc( ctx->heap, nslots, sizeof(size_t) );
+    if( !keys || !slots ) {
+        ss_dealloc( keys );
+        ss_dealloc( slots );
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        return -1;
     }
+    ss_dealloc( layout->keys );
+    ss_dealloc( layout->slots );
+    layout->keys   = keys;
+    layout->slots  = slots;
+    layout->nslots = nslots;
+    for( size_t i = 0 ; i < layout->count ; i++ )
+        layoutEnterNode( layout, i );
+    return 0;
+}
+
+/* Lists the nodes reachable from a pattern, each before its children,
+   and works out where each will go in the block. */
+static int layoutCollect( ss_Context* ctx, Layout* layout, ss_Pattern* pat ) {
+    if( layoutFind( layout, pat ) )
+        return 0;
+    if( layoutGrow( ctx, layout ) )
+        return -1;
     
-    saved  = *stream;
-    sscope = ss_mapNew();
-    ss_Match* next = pat->match( pat, sscope, stream );
-    ss_mapCommit( sscope );
-    ss_release( sscope );
-    while( next ) {
-        last->next = next;
-        last = next;
-        
-        saved  = *stream;
-        sscope = ss_mapNew();
-        next   = pat->match( pat, sscope, stream );
-        ss_mapCommit( sscope );
-        ss_release( sscope );
-    }
-    *stream = saved;
+    size_t      index = layout->count++;
+    LayoutNode* node  = &layout->nodes[index];
+    node->from = pat;
+    node->to   = NULL;
+    node->size = layoutSize( pat );
+    node->at   = layout->total;
+    layout->total += layoutRound( sizeof(ss_Object) + node->size ) + layoutExtra( pat );
+    layoutEnterNode( layout, index );
     
-    if( zeroOrMorePat->pat.binding && scope )
-        ss_mapPut( scope, zeroOrMorePat->pat.binding, first );
-    return first;
+    size_t       count;
+    ss_Pattern** kids = layoutKids( pat, &count );
+    for( size_t i = 0 ; i < count ; i++ ) {
+        if( layoutCollect( ctx, layout, kids[i] ) )
+            return -1;
+    }
+    return 0;
 }
 
-static void zeroOrMoreCleaner( ss_Pattern* pat ) {
-    ZeroOrMorePattern* zeroOrMorePat = (ZeroOrMorePattern*)pat;
-    ss_release( zeroOrMorePat->wrapped );
+/* Copies `size` bytes to the block at `*top`, moving it along. */
+static void* layoutPlace( char* block, size_t* top, void const* src, size_t size ) {
+    void* dst = block + *top;
+    memcpy( dst, src, size );
+    *top += layoutRound( size );
+    return dst;
 }
 
-static ss_Pattern* ss_zeroOrMorePattern( ss_Pattern* pattern ) {
-    ZeroOrMorePattern* zeroOrMorePat = ss_alloc( sizeof(ZeroOrMorePattern), TYPE_PATTERN );
-    zeroOrMorePat->pat.match   = zeroOrMoreMatcher;
-    zeroOrMorePat->pat.clean   = zeroOrMoreCleaner;
-    zeroOrMorePat->pat.binding = NULL;
-    zeroOrMorePat->wrapped     = ss_refer( pattern );
-    return (ss_Pattern*)zeroOrMorePat;
+static void layoutCopy( Layout* layout, char* block, LayoutNode* node ) {
+    ss_Object* obj = (ss_Object*)( block + node->at );
+    obj->type = TYPE_LAYOUT;
+    obj->refc = 1;
+    memcpy( obj->data, node->from, node->size );
+    
+    ss_Pattern* pat = (ss_Pattern*)obj->data;
+    size_t      top = node->at + layoutRound( sizeof(ss_Object) + node->size );
+    pat->clean  = NULL;
+    pat->filter = NULL;
+    if( pat->binding )
+        pat->binding = layoutPlace( block, &top, pat->binding, strlen( pat->binding ) + 1 );
+    
+    ss_Span** span = layoutSpan( pat );
+    if( span && *span ) {
+        *span = layoutPlace( block, &top, *span, spanSize( *span ) );
+        if( (*span)->ranges ) {
+            LayoutNode* owner = layoutFind( layout, (*span)->ranges );
+            assert( owner );
+            (*span)->ranges = ((ClassPattern*)owner->to)->ranges;
+        }
+    }
+    
+    if( pat->kind == KIND_ONE_OF ) {
+        OneOfPattern* oneOfPat = (OneOfPattern*)pat;
+        if( oneOfPat->table ) {
+            unsigned total = oneOfPat->offsets[DISPATCH_SIZE];
+            oneOfPat->table   = layoutPlace( block, &top, oneOfPat->table, sizeof(unsigned)*total );
+            oneOfPat->offsets = layoutPlace( block, &top, oneOfPat->offsets, sizeof(unsigned)*( DISPATCH_SIZE + 1 ) );
+        }
+        if( oneOfPat->trie )
+            oneOfPat->trie = layoutPlace( block, &top, oneOfPat->trie, sizeof(TrieNode)*oneOfPat->nodes );
+    }
 }
 
-
-typedef struct {
-    ss_Pattern  pat;
-    ss_Pattern* wrapped;
-} JustOnePattern;
-
-static ss_Match* justOneMatcher( ss_Pattern* p, ss_Map* scope, ss_Stream* stream ) {
-    JustOnePattern* justOnePat = (JustOnePattern*)p;
+/* Makes the single block copy of a compiled pattern.  The original is
+   left as it was, for the caller to release. */
+static ss_Pattern* ss_layout( ss_Context* ctx, ss_Pattern* pat ) {
+    Layout      layout = { 0 };
+    ss_Pattern* root   = NULL;
+    if( layoutCollect( ctx, &layout, pat ) )
+        goto done;
     
-    ss_Map*     sscope = ss_mapNew();
-    ss_Pattern* pat   = justOnePat->wrapped;
-    ss_Match*   match = pat->match( pat, sscope, stream );
-    ss_mapCommit( sscope );
-    ss_release( sscope );
-    if( justOnePat->pat.binding && scope )
-        ss_mapPut( scope, justOnePat->pat.binding, match );
-    return match;
-}
+    char* block = ss_malloc( ctx->heap, layout.total );
+    if( !block ) {
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        goto done;
+    }
+    for( size_t i = 0 ; i < layout.count ; i++ )
+        layout.nodes[i].to = (ss_Pattern*)((ss_Object*)( block + layout.nodes[i].at ))->data;
+    
+    for( size_t i = 0 ; i < layout.count ; i++ ) {
+        LayoutNode* node = &layout.nodes[i];
+        layoutCopy( &layout, block, node );
+        
+        size_t       count;
+        ss_Pattern** kids = layoutKids( node->to, &count );
+        for( size_t k = 0 ; k < count ; k++ )
+            kids[k] = layoutFind( &layout, kids[k] )->to;
+    }
+    root = layout.nodes[0].to;
 
-static void justOneCleaner( ss_Pattern* p ) {
-    JustOnePattern* justOnePat = (JustOnePattern*)p;
-    ss_release( justOnePat->wrapped );
+done:
+    ss_dealloc( layout.nodes );
+    ss_dealloc( layout.keys );
+    ss_dealloc( layout.slots );
+    return root;
 }
 
-static ss_Pattern* ss_justOnePattern( ss_Pattern* pattern ) {
-    JustOnePattern* justOnePat = ss_alloc( sizeof(JustOnePattern), TYPE_PATTERN );
-    justOnePat->pat.match   = justOneMatcher;
-    justOnePat->pat.clean   = justOneCleaner;
-    justOnePat->pat.binding = NULL;
-    justOnePat->wrapped     = ss_refer( pattern );
-    return (ss_Pattern*)justOnePat;
+static void freeLayout( void* ptr ) {
+    ss_Pattern* pat = ptr;
+    freeFilter( pat->filter );
+    ss_free( pat );
 }
 
+/******************************* Cost Analysis ********************************/
+
+/* What ss_analyze() works out for each node.  Lengths are in bytes.
+   A node `fails` if it can fail at all, and `loses` if it can fail
+   having read an unbounded stretch of input, which whatever tries
+   something else next has to read again.  A node `rescans` if such a
+   re-read can happen somewhere within it.  `steps` is how many matchers
+   a single pass through it can call, and `degree` the power of the
+   input length that the input it reads can grow with. */
 typedef struct {
-    ss_Pattern  pat;
-    ss_Pattern* wrapped;
-} OneOrMorePattern;
+    bool     done;
+    size_t   refs;
+    size_t   min;
+    size_t   max;
+    size_t   steps;
+    unsigned degree;
+    bool     fails;
+    bool     loses;
+    bool     rescans;
+} CostNode;
 
-static ss_Match* oneOrMoreMatcher( ss_Pattern* p, ss_Map* scope, ss_Stream* stream ) {
-    OneOrMorePattern* oneOrMorePat = (OneOrMorePattern*)p;
-    
-    ss_Stream   saved  = *stream;
-    ss_Map*     sscope = ss_mapNew();
-    ss_Pattern* pat    = oneOrMorePat->wrapped;
-    ss_Match*   first  = pat->match( pat, sscope, stream );
-    ss_Match*   last   = first;
-    ss_mapCommit( sscope );
-    ss_release( sscope );
-    if( !first )
-        return NULL;
-    
-    saved  = *stream;
-    sscope = ss_mapNew();
-    ss_Match* next = pat->match( pat, sscope, stream );
-    ss_mapCommit( sscope );
-    ss_release( sscope );
-    
-    while( next ) {
-        last->next = next;
-        last = next;
-        
-        saved  = *stream;
-        sscope = ss_mapNew();
-        next   = pat->match( pat, sscope, stream );
-        ss_mapCommit( sscope );
-        ss_release( sscope );
-    }
-    *stream = saved;
-    
-    if( oneOrMorePat->pat.binding && scope )
-        ss_mapPut( scope, oneOrMorePat->pat.binding, first );
-    return first;
+typedef struct {
+    Layout    layout;
+    CostNode* nodes;
+    size_t    rescans;
+    bool      measured;
+    double    bytesPerStep;
+} CostWalk;
+
+static void costMeasure( CostWalk* walk, double perStep ) {
+    if( !walk->measured || perStep < walk->bytesPerStep )
+        walk->bytesPerStep = perStep;
+    walk->measured = true;
 }
 
-static void oneOrMoreCleaner( ss_Pattern* pat ) {
-    OneOrMorePattern* oneOrMorePat = (OneOrMorePattern*)pat;
-    ss_release( oneOrMorePat->wrapped );
+/* Notes a place where an unbounded stretch of input can be read again. */
+static void costRescan( CostWalk* walk, CostNode* node ) {
+    node->rescans = true;
+    walk->rescans++;
 }
 
-static ss_Pattern* ss_oneOrMorePattern( ss_Pattern* pattern ) {
-    OneOrMorePattern* oneOrMorePat = ss_alloc( sizeof(OneOrMorePattern), TYPE_PATTERN );
-    oneOrMorePat->pat.match   = oneOrMoreMatcher;
-    oneOrMorePat->pat.clean   = oneOrMoreCleaner;
-    oneOrMorePat->pat.binding = NULL;
-    oneOrMorePat->wrapped     = ss_refer( pattern );
-    return (ss_Pattern*)oneOrMorePat;
+/* A repetition pass reads at least a byte, or else it's the last. */
+static void costRepeat( CostWalk* walk, ss_Span const* span, CostNode* body ) {
+    if( span )
+        return;
+    costMeasure( walk, (double)( body->min ? body->min : 1 )/(double)addLength( body->steps, 1 ) );
 }
 
+static CostNode* costOf( CostWalk* walk, ss_Pattern* pat ) {
+    LayoutNode* found = layoutFind( &walk->layout, pat );
+    assert( found );
+    CostNode* node = &walk->nodes[found - walk->layout.nodes];
+    node->refs++;
+    if( node->done )
+        return node;
+    node->done  = true;
+    node->steps = 1;
+    
+    size_t       count;
+    ss_Pattern** kids = layoutKids( pat, &count );
+    CostNode*    kid  = count ? costOf( walk, kids[0] ) : NULL;
+    switch( pat->kind ) {
+        case KIND_ALL_OF: {
+            bool reach = false;
+            for( size_t i = 0 ; i < count ; i++ ) {
+                CostNode* part = i ? costOf( walk, kids[i] ) : kid;
+                node->min     = addLength( node->min, part->min );
+                node->max     = addLength( node->max, part->max );
+                node->steps   = addLength( node->steps, part->steps );
+                node->fails  |= part->fails;
+                node->loses  |= part->loses || ( reach && part->fails );
+                node->rescans |= part->rescans;
+                if( part->degree > node->degree )
+                    node->degree = part->degree;
+                if( part->max == SIZE_MAX )
+                    reach = true;
+            }
+        } break;
+        case KIND_ONE_OF: {
+            OneOfPattern* oneOfPat = (OneOfPattern*)pat;
+            node->min   = count ? SIZE_MAX : 0;
+            node->fails = true;
+            for( size_t i = 0 ; i < count ; i++ ) {
+                CostNode* alt = i ? costOf( walk, kids[i] ) : kid;
+                if( alt->min < node->min )
+                    node->min = alt->min;
+                if( alt->max > node->max )
+                    node->max = alt->max;
+                if( !oneOfPat->trie )
+                    node->steps = addLength( node->steps, alt->steps );
+                node->fails  &= alt->fails;
+                node->loses  |= alt->loses;
+                node->rescans |= alt->rescans;
+                if( alt->degree > node->degree )
+                    node->degree = alt->degree;
+                if( alt->loses && i + 1 < count )
+                    costRescan( walk, node );
+            }
+            node->loses &= node->fails;
+        } break;
+        case KIND_HAS_NEXT:
+        case KIND_NOT_NEXT:
+            node->steps   = addLength( node->steps, kid->steps );
+            node->degree  = kid->degree;
+            node->fails   = pat->kind == KIND_NOT_NEXT || kid->fails;
+            node->loses   = kid->loses || ( pat->kind == KIND_NOT_NEXT && kid->max == SIZE_MAX );
+            node->rescans = kid->rescans;
+            if( kid->loses || kid->max == SIZE_MAX )
+                costRescan( walk, node );
+        break;
+        case KIND_ZERO_OR_ONE:
+        case KIND_JUST_ONE:
+            node->min     = pat->kind == KIND_JUST_ONE ? kid->min : 0;
+            node->max     = kid->max;
+            node->steps   = addLength( node->steps, kid->steps );
+            node->degree  = kid->degree;
+            node->fails   = pat->kind == KIND_JUST_ONE && kid->fails;
+            node->loses   = pat->kind == KIND_JUST_ONE && kid->loses;
+            node->rescans = kid->rescans;
+            if( pat->kind == KIND_ZERO_OR_ONE && kid->loses )
+                costRescan( walk, node );
+        break;
+        case KIND_ZERO_OR_MORE:
+        case KIND_ONE_OR_MORE:
+        case KIND_COUNT: {
+            size_t least = pat->kind == KIND_ONE_OR_MORE ? 1 : 0;
+            size_t most  = SIZE_MAX;
+            if( pat->kind == KIND_COUNT ) {
+                least = ((CountPattern*)pat)->min;
+                most  = ((CountPattern*)pat)->max;
+            }
+            node->min     = mulLength( kid->min, least );
+            node->max     = mulLength( kid->max, most );
+            node->steps   = addLength( node->steps, mulLength( kid->steps, least ? least : 1 ) );
+            node->fails   = least > 0 && kid->fails;
+            node->loses   = least > 0 && ( kid->loses || ( least > 1 && kid->max == SIZE_MAX && kid->fails ) );
+            node->rescans = kid->rescans;
+            node->degree  = kid->degree;
+            if( most == SIZE_MAX ) {
+                /* Each pass can re-read what's ahead of it, however
+                   little it consumes. */
+                if( kid->rescans )
+                    node->degree++;
+                else if( node->degree == 0 )
+                    node->degree = 1;
+            }
+            if( kid->loses )
+                costRescan( walk, node );
+            if( most > 1 )
+                costRepeat( walk, *layoutSpan( pat ), kid );
+        } break;
+        case KIND_LITERAL:
+        case KIND_CLASS:
+            ss_lengthOf( pat, ss_BYTES, &node->min, &node->max );
+            node->fails = node->max > 0;
+        break;
+    }
+    return node;
+}
 
-typedef struct {
-    ss_Pattern  pat;
-    size_t      len;
-    long        str[];
-} LiteralPattern;
-
-static ss_Match* literalMatcher( ss_Pattern* p, ss_Map* scope, ss_Stream* stream ) {
-    LiteralPattern* literalPat = (LiteralPattern*)p;
+int ss_analyze( ss_Context* ctx, ss_Pattern* pat, ss_Cost* cost ) {
+    memset( cost, 0, sizeof(ss_Cost) );
     
-    char const* loc = stream->loc;
-    for( unsigned i = 0 ; i < literalPat->len ; i++ ) {
-        if( literalPat->str[i] != stream->read( stream ) )
-            return NULL;
+    CostWalk walk = { 0 };
+    int      ret  = -1;
+    if( layoutCollect( ctx, &walk.layout, pat ) )
+        goto done;
+    walk.nodes = ss_calloc( ctx->heap, walk.layout.count, sizeof(CostNode) );
+    if( !walk.nodes ) {
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        goto done;
     }
-    char const* end = stream->loc;
     
-    ss_Match* match = ss_alloc( sizeof(ss_Match), TYPE_MATCH );
-    match->scope = NULL;
-    match->next  = NULL;
-    match->loc   = loc;
-    match->end   = end;
+    CostNode* root = costOf( &walk, pat );
+    if( !walk.measured )
+        costMeasure( &walk, (double)root->min/(double)root->steps );
     
-    if( literalPat->pat.binding && scope )
-        ss_mapPut( scope, literalPat->pat.binding, match );
-    return match;
-}
-
-static ss_Pattern* ss_literalPattern( long const* str, size_t len ) {
-    LiteralPattern* literalPat = ss_alloc( sizeof(LiteralPattern) + sizeof(long)*len, TYPE_PATTERN );
-    literalPat->pat.match   = literalMatcher;
-    literalPat->pat.clean   = NULL;
-    literalPat->pat.binding = NULL;
-    memcpy( literalPat->str, str, sizeof(long)*len );
-    literalPat->len = len;
-    return (ss_Pattern*)literalPat;
+    cost->depth        = pat->depth;
+    cost->nodes        = walk.layout.count;
+    cost->bytes        = walk.layout.total;
+    cost->rescans      = walk.rescans;
+    cost->degree       = root->degree;
+    cost->unbounded    = root->loses;
+    cost->bytesPerStep = walk.bytesPerStep;
+    for( size_t i = 0 ; i < walk.layout.count ; i++ ) {
+        if( walk.nodes[i].refs > 1 )
+            cost->shared++;
+    }
+    if( pat->filter ) {
+        cost->bytes += sizeof(ss_Filter)*2;
+        for( int fmt = ss_BYTES ; fmt <= ss_CHARS ; fmt++ ) {
+            if( pat->filter[fmt].rest )
+                cost->bytes += sizeof(size_t)*2*pat->filter[fmt].steps;
+        }
+    }
+    ret = 0;
+
+done:
+    ss_dealloc( walk.nodes );
+    ss_dealloc( walk.layout.nodes );
+    ss_dealloc( walk.layout.keys );
+    ss_dealloc( walk.layout.slots );
+    return ret;
 }
 
+/*********************************** Threads **********************************/
+
+/* Batch work is shared out between threads made with pthreads or the
+   Windows API.  Building with ss_NO_THREADS defined leaves them out, and
+   the calling thread does all the work. */
+#if defined(ss_NO_THREADS)
+typedef int              ss_Handle;
+typedef int              ss_Lock;
+#elif defined(_WIN32)
+typedef HANDLE           ss_Handle;
+typedef CRITICAL_SECTION ss_Lock;
+#else
+typedef pthread_t        ss_Handle;
+typedef pthread_mutex_t  ss_Lock;
+#endif
 
-/****************************** Named Patterns ********************************/
-
-static ss_Match* charMatcher( ss_Pattern* p, ss_Map* scope, ss_Stream* stream ) {
-    char const* loc = stream->loc;
-    long        chr = stream->read( stream );
-    char const* end = stream->loc;
-    if( chr < 0 )
-        return NULL;
-    
-    ss_Match* match = ss_alloc( sizeof(ss_Match), TYPE_MATCH );
-    match->scope = NULL;
-    match->next  = NULL;
-    match->loc   = loc;
-    match->end   = end;
-    return match;
+typedef struct {
+    void    (*run)( void* arg );
+    void*     arg;
+    ss_Handle handle;
+} ss_Thread;
+
+/* Threads give back their pooled blocks as they finish, since nothing
+   else can. */
+#if defined(_WIN32) && !defined(ss_NO_THREADS)
+static DWORD WINAPI threadMain( LPVOID ptr ) {
+    ss_Thread* thread = ptr;
+    thread->run( thread->arg );
+    ss_poolTrim();
+    return 0;
+}
+#elif !defined(ss_NO_THREADS)
+static void* threadMain( void* ptr ) {
+    ss_Thread* thread = ptr;
+    thread->run( thread->arg );
+    ss_poolTrim();
+    return NULL;
+}
+#endif
+
+/* Runs `run` on a thread of its own, false if one couldn't be made. */
+static bool threadStart( ss_Thread* thread, void (*run)( void* arg ), void* arg ) {
+    thread->run = run;
+    thread->arg = arg;
+    #if defined(ss_NO_THREADS)
+        return false;
+    #elif defined(_WIN32)
+        thread->handle = CreateThread( NULL, 0, threadMain, thread, 0, NULL );
+        return thread->handle != NULL;
+    #else
+        return pthread_create( &thread->handle, NULL, threadMain, thread ) == 0;
+    #endif
 }
 
-static ss_Pattern* ss_charPattern( void ) {
-    ss_Pattern* pat = ss_alloc( sizeof(ss_Pattern), TYPE_PATTERN );
-    pat->match   = charMatcher;
-    pat->clean   = NULL;
-    pat->binding = NULL;
-    return pat;
+static void threadJoin( ss_Thread* thread ) {
+    #if defined(_WIN32) && !defined(ss_NO_THREADS)
+        WaitForSingleObject( thread->handle, INFINITE );
+        CloseHandle( thread->handle );
+    #elif !defined(ss_NO_THREADS)
+        pthread_join( thread->handle, NULL );
+    #endif
 }
 
-static ss_Match* digitMatcher( ss_Pattern* p, ss_Map* scope, ss_Stream* stream ) {
-    char const* loc = stream->loc;
-    long        chr = stream->read( stream );
-    char const* end = stream->loc;
-    if( !isdigit( chr ) )
-        return NULL;
-    
-    ss_Match* match = ss_alloc( sizeof(ss_Match), TYPE_MATCH );
-    match->scope = NULL;
-    match->next  = NULL;
-    match->loc   = loc;
-    match->end   = end;
-    return match;
+static void lockInit( ss_Lock* lock ) {
+    #if defined(ss_NO_THREADS)
+        *lock = 0;
+    #elif defined(_WIN32)
+        InitializeCriticalSection( lock );
+    #else
+        pthread_mutex_init( lock, NULL );
+    #endif
 }
 
-static ss_Pattern* ss_digitPattern( void ) {
-    ss_Pattern* pat = ss_alloc( sizeof(ss_Pattern), TYPE_PATTERN );
-    pat->match   = digitMatcher;
-    pat->clean   = NULL;
-    pat->binding = NULL;
-    return pat;
+static void lockFree( ss_Lock* lock ) {
+    #if defined(_WIN32) && !defined(ss_NO_THREADS)
+        DeleteCriticalSection( lock );
+    #elif !defined(ss_NO_THREADS)
+        pthread_mutex_destroy( lock );
+    #endif
 }
 
-static ss_Match* alphaMatcher( ss_Pattern* p, ss_Map* scope, ss_Stream* stream ) {
-    char const* loc = stream->loc;
-    long        chr = stream->read( stream );
-    char const* end = stream->loc;
-    if( !isalpha( chr ) )
-        return NULL;
-    
-    ss_Match* match = ss_alloc( sizeof(ss_Match), TYPE_MATCH );
-    match->scope = NULL;
-    match->next  = NULL;
-    match->loc   = loc;
-    match->end   = end;
-    return match;
+static void lockTake( ss_Lock* lock ) {
+    #if defined(_WIN32) && !defined(ss_NO_THREADS)
+        EnterCriticalSection( lock );
+    #elif !defined(ss_NO_THREADS)
+        pthread_mutex_lock( lock );
+    #endif
 }
 
-static ss_Pattern* ss_alphaPattern( void ) {
-    ss_Pattern* pat = ss_alloc( sizeof(ss_Pattern), TYPE_PATTERN );
-    pat->match   = alphaMatcher;
-    pat->clean   = NULL;
-    pat->binding = NULL;
-    return pat;
+static void lockGive( ss_Lock* lock ) {
+    #if defined(_WIN32) && !defined(ss_NO_THREADS)
+        LeaveCriticalSection( lock );
+    #elif !defined(ss_NO_THREADS)
+        pthread_mutex_unlock( lock );
+    #endif
 }
 
-static ss_Match* alnumMatcher( ss_Pattern* p, ss_Map* scope, ss_Stream* stream ) {
-    char const* loc = stream->loc;
-    long        chr = stream->read( stream );
-    char const* end = stream->loc;
-    if( !isalnum( chr ) )
+/* Patterns are only read while matching, so threads can share one as
+   long as each matches with a context of its own.  This makes that
+   context, with the allocator and limits of the one the work came from.
+   A memory limit is shared out rather than copied, each of `workers`
+   getting an even share of what the context has left, so the batch as a
+   whole stays within it. */
+static ss_Context* workerContext( ss_Context* ctx, unsigned workers ) {
+    ss_Context* wctx = ss_initWith( ctx->heap->system ? NULL : &ctx->heap->alloc );
+    if( !wctx ) {
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
         return NULL;
-    
-    ss_Match* match = ss_alloc( sizeof(ss_Match), TYPE_MATCH );
-    match->scope = NULL;
-    match->next  = NULL;
-    match->loc   = loc;
-    match->end   = end;
-    return match;
+    }
+    wctx->maxsteps = ctx->maxsteps;
+    wctx->maxtime  = ctx->maxtime;
+    if( ctx->heap->limit ) {
+        size_t left  = ctx->heap->limit > ctx->heap->used ? ctx->heap->limit - ctx->heap->used : 0;
+        size_t share = left/workers;
+        wctx->heap->limit = share ? share : 1;
+    }
+    return wctx;
 }
 
-static ss_Pattern* ss_alnumPattern( void ) {
-    ss_Pattern* pat = ss_alloc( sizeof(ss_Pattern), TYPE_PATTERN );
-    pat->match   = alnumMatcher;
-    pat->clean   = NULL;
-    pat->binding = NULL;
-    return pat;
-}
+/******************************* Batch Scanning *******************************/
 
-static ss_Match* blankMatcher( ss_Pattern* p, ss_Map* scope, ss_Stream* stream ) {
-    char const* loc = stream->loc;
-    long        chr = stream->read( stream );
-    char const* end = stream->loc;
-    if( !isblank( chr ) )
-        return NULL;
+/* What the workers on a batch share: either the paths of files, handed
+   out in order from `next`, or texts, shared out in ranges.  The first
+   error is kept to be reported once they're done. */
+typedef struct ss_Worker ss_Worker;
+typedef struct {
+    ss_OnMatch         each;
+    void*              data;
+    ss_Lock            lock;
+    bool               stop;
+    ss_Error           errnum;
+    char const*        errmsg;
+    char const*        errloc;
     
-    ss_Match* match = ss_alloc( sizeof(ss_Match), TYPE_MATCH );
-    match->scope = NULL;
-    match->next  = NULL;
-    match->loc   = loc;
-    match->end   = end;
-    return match;
+    char const* const* paths;
+    ss_Text const*     texts;
+    size_t             count;
+    size_t             next;
+    ss_Worker*         workers;
+    unsigned           nworkers;
+} ss_Batch;
+
+/* Each worker has its own context, and a scanner it points at each input
+   it takes in turn, so the scanner and the blocks the worker's thread
+   pools are reused from one input to the next.  A worker on texts has
+   the range from `lo` to `hi` still to do, which others can steal the
+   far half of. */
+struct ss_Worker {
+    ss_Batch*   batch;
+    ss_Context* ctx;
+    ss_Scanner* scanner;
+    ss_Thread   thread;
+    ss_Lock     lock;
+    size_t      lo;
+    size_t      hi;
+    FILE*       file;
+    bool        failed;
+};
+
+static void batchFail( ss_Batch* batch, ss_Error err, char const* msg, char const* loc ) {
+    lockTake( &batch->lock );
+    if( !batch->errnum ) {
+        batch->errnum = err;
+        batch->errmsg = msg;
+        batch->errloc = loc;
+    }
+    lockGive( &batch->lock );
 }
 
-static ss_Pattern* ss_blankPattern( void ) {
-    ss_Pattern* pat = ss_alloc( sizeof(ss_Pattern), TYPE_PATTERN );
-    pat->match   = blankMatcher;
-    pat->clean   = NULL;
-    pat->binding = NULL;
-    return pat;
+static bool batchStopped( ss_Batch* batch ) {
+    lockTake( &batch->lock );
+    bool stop = batch->stop;
+    lockGive( &batch->lock );
+    return stop;
 }
 
-static ss_Match* spaceMatcher( ss_Pattern* p, ss_Map* scope, ss_Stream* stream ) {
-    char const* loc = stream->loc;
-    long        chr = stream->read( stream );
-    char const* end = stream->loc;
-    if( !isspace( chr ) )
-        return NULL;
+/* Passes each match in a worker's input to the callback, stopping the
+   batch if it asks to, and giving up on the input as soon as another
+   worker's callback has.  Errors are reported at `loc`, or where
+   matching failed if that's NULL. */
+static void batchScan( ss_Worker* worker, size_t index, char const* loc ) {
+    ss_Batch*   batch = worker->batch;
+    ss_Context* ctx   = worker->ctx;
+    bool        stop  = false;
+    ss_Match*   match;
+    while( !stop && !batchStopped( batch ) && ( match = ss_find( ctx, worker->scanner ) ) ) {
+        uint64_t pos = ss_position( ctx, worker->scanner, match->loc );
+        stop = batch->each( ctx, batch->data, index, match, pos ) != 0;
+        ss_release( match );
+    }
     
-    ss_Match* match = ss_alloc( sizeof(ss_Match), TYPE_MATCH );
-    match->scope = NULL;
-    match->next  = NULL;
-    match->loc   = loc;
-    match->end   = end;
-    return match;
+    if( stop ) {
+        lockTake( &batch->lock );
+        batch->stop = true;
+        lockGive( &batch->lock );
+    }
+    else
+    if( ctx->errnum ) {
+        batchFail( batch, ctx->errnum, ctx->errmsg, loc ? loc : ctx->errloc );
+        ss_errclr( ctx );
+    }
 }
 
-static ss_Pattern* ss_spacePattern( void ) {
-    ss_Pattern* pat = ss_alloc( sizeof(ss_Pattern), TYPE_PATTERN );
-    pat->match   = spaceMatcher;
-    pat->clean   = NULL;
-    pat->binding = NULL;
-    return pat;
+static size_t fileRead( void* data, char* buf, size_t cap ) {
+    ss_Worker* worker = data;
+    size_t     got    = fread( buf, 1, cap, worker->file );
+    if( got == 0 && ferror( worker->file ) )
+        worker->failed = true;
+    return got;
 }
 
-
-static ss_Match* upperMatcher( ss_Pattern* p, ss_Map* scope, ss_Stream* stream ) {
-    char const* loc = stream->loc;
-    long        chr = stream->read( stream );
-    char const* end = stream->loc;
-    if( !isupper( chr ) )
-        return NULL;
-    
-    ss_Match* match = ss_alloc( sizeof(ss_Match), TYPE_MATCH );
-    match->scope = NULL;
-    match->next  = NULL;
-    match->loc   = loc;
-    match->end   = end;
-    return match;
+/* Takes files until there are none left or the batch is stopped.  A
+   file that can't be read or matched is given up on, and the rest go
+   on. */
+static void fileWork( void* arg ) {
+    ss_Worker* worker = arg;
+    ss_Batch*  batch  = worker->batch;
+    for( ;; ) {
+        lockTake( &batch->lock );
+        size_t index = batch->stop ? batch->count : batch->next;
+        if( index < batch->count )
+            batch->next++;
+        lockGive( &batch->lock );
+        if( index == batch->count )
+            return;
+        
+        char const* path = batch->paths[index];
+        worker->file = fopen( path, "rb" );
+        if( !worker->file ) {
+            batchFail( batch, ss_ERR_IO, NULL, path );
+            continue;
+        }
+        setvbuf( worker->file, NULL, _IONBF, 0 );
+        worker->failed = false;
+        readerRewind( worker->scanner );
+        batchScan( worker, index, path );
+        fclose( worker->file );
+        if( worker->failed )
+            batchFail( batch, ss_ERR_IO, NULL, path );
+    }
 }
 
-static ss_Pattern* ss_upperPattern( void ) {
-    ss_Pattern* pat = ss_alloc( sizeof(ss_Pattern), TYPE_PATTERN );
-    pat->match   = upperMatcher;
-    pat->clean   = NULL;
-    pat->binding = NULL;
-    return pat;
+static bool textTake( ss_Worker* worker, size_t* index ) {
+    lockTake( &worker->lock );
+    bool took = worker->lo < worker->hi;
+    if( took )
+        *index = worker->lo++;
+    lockGive( &worker->lock );
+    return took;
 }
 
-static ss_Match* lowerMatcher( ss_Pattern* p, ss_Map* scope, ss_Stream* stream ) {
-    char const* loc = stream->loc;
-    long        chr = stream->read( stream );
-    char const* end = stream->loc;
-    if( !islower( chr ) )
-        return NULL;
-    
-    ss_Match* match = ss_alloc( sizeof(ss_Match), TYPE_MATCH );
-    match->scope = NULL;
-    match->next  = NULL;
-    match->loc   = loc;
-    match->end   = end;
-    return match;
+/* Moves the far half of the most texts any other worker has left over
+   to an idle one, false once there are none left anywhere.  Only one
+   lock is held at a time, so a victim that runs dry before it's robbed
+   is just looked past. */
+static bool textSteal( ss_Worker* thief ) {
+    ss_Batch* batch = thief->batch;
+    for( ;; ) {
+        ss_Worker* victim = NULL;
+        size_t     most   = 0;
+        for( unsigned i = 0 ; i < batch->nworkers ; i++ ) {
+            ss_Worker* worker = &batch->workers[i];
+            if( worker == thief )
+                continue;
+            lockTake( &worker->lock );
+            size_t left = worker->hi - worker->lo;
+            lockGive( &worker->lock );
+            if( left > most ) {
+                most   = left;
+                victim = worker;
+            }
+        }
+        if( !victim )
+            return false;
+        
+        lockTake( &victim->lock );
+        size_t left = victim->hi - victim->lo;
+        size_t hi   = victim->hi;
+        size_t mid  = hi - ( left + 1 )/2;
+        victim->hi = mid;
+        lockGive( &victim->lock );
+        if( left == 0 )
+            continue;
+        
+        lockTake( &thief->lock );
+        thief->lo = mid;
+        thief->hi = hi;
+        lockGive( &thief->lock );
+        return true;
+    }
 }
 
-static ss_Pattern* ss_lowerPattern( void ) {
-    ss_Pattern* pat = ss_alloc( sizeof(ss_Pattern), TYPE_PATTERN );
-    pat->match   = lowerMatcher;
-    pat->clean   = NULL;
-    pat->binding = NULL;
-    return pat;
+/* Works through the worker's own range of texts, then steals from the
+   others until there are none left or the batch is stopped. */
+static void textWork( void* arg ) {
+    ss_Worker* worker = arg;
+    ss_Batch*  batch  = worker->batch;
+    size_t     index;
+    while( textTake( worker, &index ) || ( textSteal( worker ) && textTake( worker, &index ) ) ) {
+        if( batchStopped( batch ) )
+            return;
+        scannerRewind( worker->scanner, &batch->texts[index] );
+        batchScan( worker, index, NULL );
+    }
 }
 
-
-static void ss_prelude( ss_Context* ctx ) {
-    ss_Pattern* charPat = ss_charPattern();
-    ss_mapPut( ctx->patterns, "char", charPat );
-    ss_release( charPat );
-    
-    ss_Pattern* digitPat = ss_digitPattern();
-    ss_mapPut( ctx->patterns, "digit", digitPat );
-    ss_release( digitPat );
+/* Runs `threads` workers on a batch, the calling thread among them.  If
+   fewer threads can be made, the ones that are do the extra work. */
+static int batchRun( ss_Context* ctx, ss_Batch* batch, ss_Pattern* pat, ss_Format fmt, unsigned threads ) {
+    if( threads == 0 )
+        threads = 1;
+    if( threads > batch->count )
+        threads = batch->count ? (unsigned)batch->count : 1;
     
-    ss_Pattern* alphaPat = ss_alphaPattern();
-    ss_mapPut( ctx->patterns, "alpha", alphaPat );
-    ss_release( alphaPat );
-    
-    ss_Pattern* alnumPat = ss_alnumPattern();
-    ss_mapPut( ctx->patterns, "alnum", alnumPat );
-    ss_release( alnumPat );
-    
-    ss_Pattern* blankPat = ss_blankPattern();
-    ss_mapPut( ctx->patterns, "blank", blankPat );
-    ss_release( blankPat );
+    ss_Worker* workers = ss_calloc( ctx->heap, threads, sizeof(ss_Worker) );
+    if( !workers ) {
+        ss_error( ctx, ss_ERR_ALLOC, NULL );
+        return -1;
+    }
+    batch->workers  = workers;
+    batch->nworkers = threads;
+    lockInit( &batch->lock );
     
-    ss_Pattern* spacePat = ss_spacePattern();
-    ss_mapPut( ctx->patterns, "space", spacePat );
-    ss_release( spacePat );
+    int      ret  = -1;
+    unsigned made = 0;
+    for( ; made < threads ; made++ ) {
+        ss_Worker* worker = &workers[made];
+        worker->batch = batch;
+        worker->ctx   = workerContext( ctx, threads );
+        if( !worker->ctx )
+            goto done;
+        lockInit( &worker->lock );
+        worker->lo = batch->count*made/threads;
+        worker->hi = batch->count*( made + 1 )/threads;
+        if( batch->paths ) {
+            worker->scanner = ss_startReader( worker->ctx, pat, fmt, fileRead, worker );
+        }
+        else {
+            ss_Text first = batch->count ? batch->texts[0] : (ss_Text){ fmt, 0, "" };
+            worker->scanner = ss_start( worker->ctx, pat, &first );
+        }
+        if( !worker->scanner ) {
+            ss_error( ctx, worker->ctx->errnum, worker->ctx->errmsg );
+            made++;
+            goto done;
+        }
+    }
     
-    ss_Pattern* upperPat = ss_upperPattern();
-    ss_mapPut( ctx->patterns, "upper", upperPat );
-    ss_release( upperPat );
+    void (*work)( void* arg ) = batch->paths ? fileWork : textWork;
+    unsigned started = 1;
+    while( started < threads && threadStart( &workers[started].thread, work, &workers[started] ) )
+        started++;
+    work( &workers[0] );
+    for( unsigned i = 1 ; i < started ; i++ )
+        threadJoin( &workers[i].thread );
     
-    ss_Pattern* lowerPat = ss_lowerPattern();
-    ss_mapPut( ctx->patterns, "lower", lowerPat );
-    ss_release( lowerPat );
+    if( batch->errnum ) {
+        ss_error( ctx, batch->errnum, batch->errmsg );
+        ctx->errloc = batch->errloc;
+    }
+    else {
+        ret = 0;
+    }
     
-    ss_mapCommit( ctx->patterns );
+done:
+    for( unsigned i = 0 ; i < made ; i++ ) {
+        if( workers[i].scanner )
+            ss_release( workers[i].scanner );
+        ss_release( workers[i].ctx );
+        lockFree( &workers[i].lock );
+    }
+    lockFree( &batch->lock );
+    ss_dealloc( workers );
+    return ret;
+}
+
+/* Scans each of a batch of files for a pattern, calling `each` with
+   every match and the index of its file.  Files are shared out between
+   `threads` workers as each becomes free, the calling thread among
+   them, so one worker's matching overlaps another's reads and a large
+   file holds up only the worker scanning it.  Each file is read a
+   window at a time as by ss_startReader(), and `each` gets the worker's
+   context to look into the match with.  It can be called from several
+   threads at once, and returning non-zero stops the scan.  Files that
+   can't be read or matched are skipped, and the first such failure is
+   reported once the rest are done, with the file's path as the error
+   location. */
+int ss_scanFiles( ss_Context* ctx, ss_Pattern* pat, ss_Format fmt, char const* const* paths, size_t count, unsigned threads, ss_OnMatch each, void* data ) {
+    ss_Batch batch = { .each = each, .data = data, .paths = paths, .count = count };
+    return batchRun( ctx, &batch, pat, fmt, threads );
+}
+
+/* Scans each of a batch of texts the way ss_scanFiles() scans files.
+   Each worker starts with an even share of the texts, and one that runs
+   out takes half of what's left to the busiest, so a few long texts
+   don't leave the other workers idle.  A text that fails to match is
+   reported at the point it failed. */
+int ss_scanTexts( ss_Context* ctx, ss_Pattern* pat, ss_Text const* texts, size_t count, unsigned threads, ss_OnMatch each, void* data ) {
+    ss_Batch batch = { .each = each, .data = data, .texts = texts, .count = count };
+    return batchRun( ctx, &batch, pat, count ? texts[0].fmt : ss_BYTES, threads );
 }
@@ -1,12 +1,15 @@
 #ifndef ss_h
 #define ss_h
 #include <stddef.h>
+#include <stdint.h>
 
 typedef struct ss_Match   ss_Match;
 typedef struct ss_Scanner ss_Scanner;
 typedef struct ss_Pattern ss_Pattern;
 typedef struct ss_Context ss_Context;
 typedef struct ss_Text    ss_Text;
+typedef struct ss_Binding ss_Binding;
+typedef struct ss_Feed    ss_Feed;
 
 typedef enum {
     ss_BYTES,
@@ -18,7 +21,11 @@ typedef enum {
     ss_ERR_ALLOC,
     ss_ERR_FORMAT,
     ss_ERR_SYNTAX,
-    ss_ERR_UNDEFINED
+    ss_ERR_UNDEFINED,
+    ss_ERR_DEPTH,
+    ss_ERR_TIMEOUT,
+    ss_ERR_MORE,
+    ss_ERR_IO
 } ss_Error;
 
 typedef struct {
@@ -27,22 +34,83 @@ typedef struct {
     char const* str;
 } ss_Slice;
 
+struct ss_Text {
+    ss_Format   fmt;
+    size_t      len;
+    char const* str;
+};
+
+typedef size_t (*ss_Reader)( void* data, char* buf, size_t cap );
+
+typedef struct {
+    void* (*alloc)( void* data, size_t size );
+    void* (*resize)( void* data, void* ptr, size_t size );
+    void  (*free)( void* data, void* ptr );
+    void*   data;
+} ss_Allocator;
+
 ss_Context* ss_init( void );
+ss_Context* ss_initWith( ss_Allocator const* allocator );
+void        ss_limitDepth( ss_Context* ctx, unsigned depth );
+void        ss_limitMemory( ss_Context* ctx, size_t bytes );
+size_t      ss_memoryUsed( ss_Context* ctx );
+void        ss_limitSteps( ss_Context* ctx, size_t steps );
+void        ss_limitTime( ss_Context* ctx, unsigned long micros );
 
 ss_Pattern* ss_compile( ss_Context* ctx, ss_Text const* txt );
 void        ss_define( ss_Context* ctx, char const* name, ss_Pattern* pat );
 ss_Error    ss_errnum( ss_Context* ctx );
 char const* ss_errmsg( ss_Context* ctx );
+char const* ss_errloc( ss_Context* ctx );
 void        ss_errclr( ss_Context* ctx );
 
 
 ss_Match*   ss_match( ss_Context* ctx, ss_Pattern* pat, ss_Text* txt );
+int         ss_matchMany( ss_Context* ctx, ss_Pattern* pat, ss_Text const* texts, size_t count, unsigned char* bits );
 ss_Scanner* ss_start( ss_Context* ctx, ss_Pattern* pat, ss_Text* txt );
 ss_Match*   ss_find( ss_Context* ctx, ss_Scanner* scanner );
+ss_Scanner* ss_startReader( ss_Context* ctx, ss_Pattern* pat, ss_Format fmt, ss_Reader read, void* data );
+ss_Scanner* ss_startSlices( ss_Context* ctx, ss_Pattern* pat, ss_Slice const* slices, size_t count );
+uint64_t    ss_position( ss_Context* ctx, ss_Scanner* scanner, char const* loc );
+
+typedef int (*ss_OnMatch)( ss_Context* ctx, void* data, size_t index, ss_Match* match, uint64_t pos );
+int         ss_scanFiles( ss_Context* ctx, ss_Pattern* pat, ss_Format fmt, char const* const* paths, size_t count, unsigned threads, ss_OnMatch each, void* data );
+int         ss_scanTexts( ss_Context* ctx, ss_Pattern* pat, ss_Text const* texts, size_t count, unsigned threads, ss_OnMatch each, void* data );
 char const* ss_loc( ss_Context* ctx, ss_Match* match );
 char const* ss_end( ss_Context* ctx, ss_Match* match );
 ss_Match*   ss_get( ss_Context* ctx, ss_Match* match, char const* binding );
+size_t      ss_count( ss_Context* ctx, ss_Match* match );
+ss_Match*   ss_getIndex( ss_Context* ctx, ss_Match* match, size_t index );
+ss_Binding* ss_bind( ss_Context* ctx, ss_Pattern* pat, char const* path );
+ss_Match*   ss_getBound( ss_Context* ctx, ss_Match* match, ss_Binding const* binding );
+
+ss_Feed*    ss_feed( ss_Context* ctx, ss_Pattern* pat, ss_Format fmt );
+ss_Match*   ss_feedMore( ss_Context* ctx, ss_Feed* feed, char const* str, size_t len );
+ss_Match*   ss_feedEnd( ss_Context* ctx, ss_Feed* feed );
 
 void        ss_release( void* ptr );
 
+typedef struct {
+    unsigned depth;
+    size_t   nodes;
+    size_t   shared;
+    size_t   bytes;
+    size_t   rescans;
+    unsigned degree;
+    int      unbounded;
+    double   bytesPerStep;
+} ss_Cost;
+
+int         ss_analyze( ss_Context* ctx, ss_Pattern* pat, ss_Cost* cost );
+
+typedef struct {
+    size_t hits;
+    size_t misses;
+    size_t cached;
+    size_t peak;
+} ss_PoolStats;
+
+void        ss_poolStats( ss_PoolStats* stats );
+void        ss_poolTrim( void );
+
 #endif
\ No newline at end of file
@@ -7,28 +7,59 @@
 
 static bool testMatch( ss_Context* ctx, ss_Format fmt, char const* p, char const* s ) {
     ss_Pattern* pat         = NULL;
-    ss_Scanner* scanner     = NULL;
+    ss_Text     txt         = { fmt, strlen( s ), s };
     ss_Match*   match       = NULL;
     
-    pat = ss_compile( ctx, fmt, p, strlen( p ) );
-    if( ss_error( ctx ) )
+    pat = ss_compile( ctx, &(ss_Text){ fmt, strlen( p ), p } );
+    if( ss_errnum( ctx ) )
         goto fail;
     
-    scanner = ss_start( ctx, fmt, pat, s, strlen( s ) );
-    if( ss_error( ctx ) )
+    match = ss_match( ctx, pat, &txt );
+    if( !match )
         goto fail;
     
-    match = ss_match( scanner );
-    if( !match )
+    if( ss_loc( ctx, match ) != s )
+        goto fail;
+    if( ss_end( ctx, match ) != s + strlen( s ) )
+        goto fail;
+    
+    ss_release( match );
+    ss_release( pat );
+    return true;
+    
+fail:
+    if( match )
+        ss_release( match );
+    if( pat )
+        ss_release( pat );
+    return false;
+}
+
+static bool testFind( ss_Context* ctx, ss_Format fmt, char const* p, char const* s, size_t count, size_t first ) {
+    ss_Pattern* pat         = NULL;
+    ss_Scanner* scanner     = NULL;
+    ss_Match*   match       = NULL;
+    size_t      found       = 0;
+    
+    pat = ss_compile( ctx, &(ss_Text){ fmt, strlen( p ), p } );
+    if( ss_errnum( ctx ) )
         goto fail;
     
-    if( ss_loc( match ) != s )
+    scanner = ss_start( ctx, pat, &(ss_Text){ fmt, strlen( s ), s } );
+    if( ss_errnum( ctx ) )
         goto fail;
-    if( ss_end( match ) != s + strlen( s ) )
+    
+    while( ( match = ss_find( ctx, scanner ) ) ) {
+        if( found == 0 && ss_loc( ctx, match ) != s + first )
+            goto fail;
+        found++;
+        ss_release( match );
+        match = NULL;
+    }
+    if( found != count )
         goto fail;
     
     ss_release( scanner );
-    ss_release( match );
     ss_release( pat );
     return true;
     
@@ -171,12 +202,12 @@ static bool test11( void ) {
     ss_Context* ctx = ss_init();
     
     char const  splatSrc[] = "< ~'/' ~'.' char >";
-    ss_Pattern* splatPat = ss_compile( ctx, ss_BYTES, splatSrc, strlen( splatSrc ) );
+    ss_Pattern* splatPat = ss_compile( ctx, &(ss_Text){ ss_BYTES, strlen( splatSrc ), splatSrc } );
     ss_define( ctx, "splat", splatPat );
     ss_release( splatPat );
     
     char const  quarkSrc[] = "(char)";
-    ss_Pattern* quarkPat = ss_compile( ctx, ss_BYTES, quarkSrc, strlen( quarkSrc ) );
+    ss_Pattern* quarkPat = ss_compile( ctx, &(ss_Text){ ss_BYTES, strlen( quarkSrc ), quarkSrc } );
     ss_define( ctx, "quark", quarkPat );
     ss_release( quarkPat );
     
@@ -202,43 +233,38 @@ static bool test12( void ) {
     char const* s = "I have two apples.";
     
     ss_Pattern* pat         = NULL;
-    ss_Scanner* scanner     = NULL;
+    ss_Text     txt         = { ss_BYTES, strlen( s ), s };
     ss_Match*   match       = NULL;
     ss_Match*   fruit       = NULL;
     ss_Match*   apples      = NULL;
     ss_Match*   oranges     = NULL;
     
-    pat = ss_compile( ctx, ss_BYTES, p, strlen( p ) );
-    if( ss_error( ctx ) )
-        goto fail;
-    
-    scanner = ss_start( ctx, ss_BYTES, pat, s, strlen( s ) );
-    if( ss_error( ctx ) )
+    pat = ss_compile( ctx, &(ss_Text){ ss_BYTES, strlen( p ), p } );
+    if( ss_errnum( ctx ) )
         goto fail;
     
-    match = ss_match( scanner );
+    match = ss_match( ctx, pat, &txt );
     if( !match )
         goto fail;
     
-    fruit = ss_get( match, "fruit" );
+    fruit = ss_get( ctx, match, "fruit" );
     if( !fruit )
         goto fail;
-    if( ss_loc( fruit ) != s + 11 )
+    if( ss_loc( ctx, fruit ) != s + 11 )
         goto fail;
-    if( ss_end( fruit ) != s + 17 )
+    if( ss_end( ctx, fruit ) != s + 17 )
         goto fail;
     
-    apples = ss_get( fruit, "apples" );
+    apples = ss_get( ctx, fruit, "apples" );
     if( !apples )
         goto fail;
     
-    oranges = ss_get( fruit, "oranges" );
+    oranges = ss_get( ctx, fruit, "oranges" );
     if( oranges )
         goto fail;
     
     ss_release( apples );
     ss_release( fruit );
-    ss_release( scanner );
     ss_release( match );
     ss_release( pat );
     ss_release( ctx );
@@ -251,8 +277,6 @@ fail:
         ss_release( oranges );
     if( fruit )
         ss_release( fruit );
-    if( scanner )
-        ss_release( scanner );
     if( match )
         ss_release( match );
     if( pat )
@@ -271,20 +295,20 @@ static bool test13( void ) {
     ss_Scanner* scanner     = NULL;
     ss_Match*   match       = NULL;
     
-    pat = ss_compile( ctx, ss_BYTES, p, strlen( p ) );
-    if( ss_error( ctx ) )
+    pat = ss_compile( ctx, &(ss_Text){ ss_BYTES, strlen( p ), p } );
+    if( ss_errnum( ctx ) )
         goto fail;
     
-    scanner = ss_start( ctx, ss_BYTES, pat, s, strlen( s ) );
-    if( ss_error( ctx ) )
+    scanner = ss_start( ctx, pat, &(ss_Text){ ss_BYTES, strlen( s ), s } );
+    if( ss_errnum( ctx ) )
         goto fail;
     
-    match = ss_find( scanner );
+    match = ss_find( ctx, scanner );
     if( !match )
         goto fail;
-    if( ss_loc( match ) != s + 9 )
+    if( ss_loc( ctx, match ) != s + 9 )
         goto fail;
-    if( ss_end( match ) != s + 14 )
+    if( ss_end( ctx, match ) != s + 14 )
         goto fail;
     
     ss_release( scanner );
@@ -329,6 +353,1522 @@ static bool test15( void ) {
     return result;
 }
 
+static bool test16( void ) {
+    ss_Context* ctx = ss_init();
+    
+    char const* p = "I say ( 'hello' | 'hi' | 'hey' | 'howdy' | { 'u' } 'm' | [ 'o' ] 'k' ).";
+    bool result = true;
+    result &= testMatch( ctx, ss_BYTES, p, "I say hello." );
+    result &= testMatch( ctx, ss_BYTES, p, "I say hi." );
+    result &= testMatch( ctx, ss_BYTES, p, "I say howdy." );
+    result &= testMatch( ctx, ss_BYTES, p, "I say m." );
+    result &= testMatch( ctx, ss_BYTES, p, "I say uum." );
+    result &= testMatch( ctx, ss_BYTES, p, "I say ok." );
+    result &= testMatch( ctx, ss_BYTES, p, "I say k." );
+    result &= !testMatch( ctx, ss_BYTES, p, "I say yo." );
+    result &= !testMatch( ctx, ss_BYTES, p, "I say ." );
+    
+    ss_release( ctx );
+    return result;
+}
+
+static bool test17( void ) {
+    ss_Context* ctx = ss_init();
+    
+    bool result = true;
+    
+    char const* p1 = "I ate < digit > tacos{ ' ' }and < alpha | digit >.";
+    result &= testMatch( ctx, ss_BYTES, p1, "I ate 12 tacos and 3burritos." );
+    result &= testMatch( ctx, ss_BYTES, p1, "I ate 1234567890123456789012345678901234567890 tacos     and more." );
+    result &= !testMatch( ctx, ss_BYTES, p1, "I ate  tacos and 3burritos." );
+    
+    char const* p2 = "( 20170 ){ char }";
+    result &= testMatch( ctx, ss_CHARS, p2, "今日は and then some more text to get past a vector width" );
+    
+    char const* p3 = "< alpha >( 26085 )";
+    result &= !testMatch( ctx, ss_CHARS, p3, "abc今日" );
+    result &= testMatch( ctx, ss_CHARS, p3, "abcdefghijklmnopqrstuvwxyzabcdefghijklmnop日" );
+    
+    /* Bytes above 0x7F are consumed the same way whether the repetition
+       goes through a span kernel or, being bound, one byte at a time. */
+    char const* s4 = "\x80\xFE\xFF bytes past ASCII \xC3\xA9\xFF\x80 and more past a vector \xFF";
+    result &= testMatch( ctx, ss_BYTES, "{ char }", s4 );
+    result &= testMatch( ctx, ss_BYTES, "{ char }:x", s4 );
+    result &= testMatch( ctx, ss_BYTES, "{ (char):c }", s4 );
+    result &= testMatch( ctx, ss_BYTES, "< ~' ' char > { char }", s4 );
+    
+    ss_release( ctx );
+    return result;
+}
+
+static bool test18( void ) {
+    ss_Context* ctx = ss_init();
+    
+    bool result = true;
+    
+    char const* p1 = "\"{ ~'\"' char }\",< ~',' ~'\n' char >";
+    result &= testMatch( ctx, ss_BYTES, p1, "\"Hello, World!\",next" );
+    result &= testMatch( ctx, ss_CHARS, p1, "\"今日は\",next" );
+    result &= !testMatch( ctx, ss_BYTES, p1, "\"Hello, World!\",next,last" );
+    
+    char const* p2 = "\\<!--{ ~'-->' char }--\\>";
+    result &= testMatch( ctx, ss_BYTES, p2, "<!-- a - b -- c -> d -->" );
+    result &= testMatch( ctx, ss_CHARS, p2, "<!-- 今日は -->" );
+    result &= !testMatch( ctx, ss_BYTES, p2, "<!-- a --> b -->" );
+    
+    /* Bound loops are matched one character at a time, and must agree
+       with the delimiter scans. */
+    char const* p3 = "\"{ ~'\"' char }:body\",< ~',' ~'\n' char >:rest";
+    result &= testMatch( ctx, ss_BYTES, p3, "\"Hello, World!\",next" );
+    result &= testMatch( ctx, ss_CHARS, p3, "\"今日は\",next" );
+    result &= !testMatch( ctx, ss_BYTES, p3, "\"Hello, World!\",next,last" );
+    
+    char const* p4 = "\\<!--{ ~'-->' char }:body--\\>";
+    result &= testMatch( ctx, ss_BYTES, p4, "<!-- a - b -- c -> d -->" );
+    result &= testMatch( ctx, ss_CHARS, p4, "<!-- 今日は -->" );
+    result &= !testMatch( ctx, ss_BYTES, p4, "<!-- a --> b -->" );
+    
+    char const* s5 = "<!-- \xFF\x80 - \xC3\xA9 -- -> -->";
+    result &= testMatch( ctx, ss_BYTES, p2, s5 );
+    result &= testMatch( ctx, ss_BYTES, p4, s5 );
+    
+    ss_release( ctx );
+    return result;
+}
+
+static bool test19( void ) {
+    ss_Context* ctx = ss_init();
+    ss_limitDepth( ctx, 16 );
+    
+    bool result = true;
+    
+    char const* p1  = "(((((((((( 'a' ))))))))))";
+    ss_Pattern* pat = ss_compile( ctx, &(ss_Text){ ss_BYTES, strlen( p1 ), p1 } );
+    result &= !pat && ss_errnum( ctx ) == ss_ERR_DEPTH;
+    ss_errclr( ctx );
+    
+    result &= testMatch( ctx, ss_BYTES, "((( 'a' )))", "a" );
+    
+    size_t len = 1 << 20;
+    char*  str = malloc( len + 1 );
+    memset( str, 'a', len );
+    str[len] = '\0';
+    result &= testMatch( ctx, ss_BYTES, "< 'a':x >", str );
+    free( str );
+    
+    ss_release( ctx );
+    return result;
+}
+
+static bool test20( void ) {
+    ss_Context* ctx = ss_init();
+    
+    bool result = true;
+    
+    char const* p1 = "(digit)#4-(digit)#2-(digit)#2";
+    result &= testMatch( ctx, ss_BYTES, p1, "2024-01-31" );
+    result &= !testMatch( ctx, ss_BYTES, p1, "224-01-31" );
+    result &= !testMatch( ctx, ss_BYTES, p1, "20245-01-31" );
+    
+    char const* p2 = "0x( digit | 'a' | 'b' | 'c' | 'd' | 'e' | 'f' )#2..8";
+    result &= testMatch( ctx, ss_BYTES, p2, "0xff" );
+    result &= testMatch( ctx, ss_BYTES, p2, "0xdeadbeef" );
+    result &= !testMatch( ctx, ss_BYTES, p2, "0xf" );
+    result &= !testMatch( ctx, ss_BYTES, p2, "0xdeadbeef0" );
+    
+    char const* p3 = "{ (digit)#1..3:octet \\. }#3..(digit)#1..3";
+    result &= testMatch( ctx, ss_BYTES, p3, "192.168.0.1" );
+    result &= testMatch( ctx, ss_BYTES, p3, "10.0.0.0.1" );
+    result &= !testMatch( ctx, ss_BYTES, p3, "10.0.1" );
+    result &= !testMatch( ctx, ss_BYTES, p3, "1000.0.0.1" );
+    
+    char const* p4 = "<'今日'>#2(char)#0..1";
+    result &= testMatch( ctx, ss_CHARS, p4, "今日今日" );
+    result &= testMatch( ctx, ss_CHARS, p4, "今日今日は" );
+    result &= !testMatch( ctx, ss_CHARS, p4, "今日" );
+    
+    ss_release( ctx );
+    return result;
+}
+
+static bool test21( void ) {
+    ss_Context* ctx = ss_init();
+    
+    bool result = true;
+    
+    char const* p1 = "( 'a'..'z' | 'A'..'Z' | '_' ){ 'a'..'z' | 'A'..'Z' | '_' | '0'..'9' }";
+    result &= testMatch( ctx, ss_BYTES, p1, "_Hello9" );
+    result &= !testMatch( ctx, ss_BYTES, p1, "9Hello" );
+    result &= !testMatch( ctx, ss_BYTES, p1, "Hello-9" );
+    
+    char const* p2 = "<0x4E00..0x9FFF | 0x3040..0x309F>";
+    result &= testMatch( ctx, ss_CHARS, p2, "今日は" );
+    result &= !testMatch( ctx, ss_CHARS, p2, "今日はabc" );
+    
+    char const* p3 = "(0x41..0x46)#2";
+    result &= testMatch( ctx, ss_BYTES, p3, "AF" );
+    result &= !testMatch( ctx, ss_BYTES, p3, "AG" );
+    
+    ss_release( ctx );
+    return result;
+}
+
+static bool test22( void ) {
+    ss_Context* ctx = ss_init();
+    
+    bool result = true;
+    
+    char const* p1 = "( 'GET' | 'POST' | 'PUT' | 'PATCH' | 'DELETE' ) /";
+    result &= testMatch( ctx, ss_BYTES, p1, "GET /" );
+    result &= testMatch( ctx, ss_BYTES, p1, "PATCH /" );
+    result &= !testMatch( ctx, ss_BYTES, p1, "PUSH /" );
+    
+    char const* p2 = "( 'in' | 'int' | 'interface' )";
+    result &= testMatch( ctx, ss_BYTES, p2, "in" );
+    result &= !testMatch( ctx, ss_BYTES, p2, "int" );
+    
+    char const* p3 = "( 'interface' | 'int' | 'in' | '' )";
+    result &= testMatch( ctx, ss_BYTES, p3, "interface" );
+    result &= testMatch( ctx, ss_BYTES, p3, "int" );
+    result &= testMatch( ctx, ss_BYTES, p3, "" );
+    result &= !testMatch( ctx, ss_BYTES, p3, "inter" );
+    
+    char const* p4 = "( '今日' | '今' | 'は' )(char)";
+    result &= testMatch( ctx, ss_CHARS, p4, "今日は" );
+    result &= testMatch( ctx, ss_CHARS, p4, "今は" );
+    
+    ss_release( ctx );
+    return result;
+}
+
+static bool test23( void ) {
+    ss_Context* ctx = ss_init();
+    
+    bool result = true;
+    
+    char const* log =
+        "10:00:01 INFO  service started on port 8080, waiting for connections\n"
+        "10:00:02 INFO  accepted connection from 10.0.0.7, handing off to worker\n"
+        "10:00:05 WARN  worker 3 is running behind, queue depth is now 118\n"
+        "10:00:09 INFO  queue drained, all workers idle again after backlog\n"
+        "10:00:12 ERROR worker 5 exited with status 1, restarting it now\n"
+        "10:00:13 INFO  worker 5 restarted and accepting jobs from the queue\n"
+        "10:00:20 FATAL out of memory, shutting the service down immediately\n";
+    
+    char const* p1 = "( 'WARN' | 'ERROR' | 'FATAL' )";
+    result &= testFind( ctx, ss_BYTES, p1, log, 3, 150 );
+    result &= testFind( ctx, ss_CHARS, p1, log, 3, 150 );
+    
+    char const* p2 = "( 'WA' | 'ER' | 'FA' | 'IN' )x";
+    result &= testFind( ctx, ss_BYTES, p2, log, 0, 0 );
+    
+    char const* p3 = "( 'port' | 'worker' ) (digit)";
+    result &= testFind( ctx, ss_BYTES, p3, log, 4, 34 );
+    
+    char const* p4 = "( '警告' | 'エラー' )";
+    char const* s4 = "ログ: 情報 起動しました。情報 接続を受け付けました。警告 キューが溢れそうです。エラー 終了しました。";
+    result &= testFind( ctx, ss_CHARS, p4, s4, 2, 76 );
+    
+    ss_release( ctx );
+    return result;
+}
+
+static bool test24( void ) {
+    ss_Context* ctx = ss_init();
+    
+    bool result = true;
+    
+    char const* p1 = "<digit> ms";
+    result &= testMatch( ctx, ss_BYTES, p1, "250 ms" );
+    result &= !testMatch( ctx, ss_BYTES, p1, "250 s" );
+    result &= !testMatch( ctx, ss_BYTES, p1, "250" );
+    
+    char const* s1 = "GET /index took 12 ms, GET /search took 340 ms, GET /login failed";
+    result &= testFind( ctx, ss_BYTES, p1, s1, 2, 16 );
+    result &= testFind( ctx, ss_BYTES, p1, "no timings in this one", 0, 0 );
+    
+    char const* p2 = "( 'took' | 'spent' ) <digit>ミリ秒";
+    result &= testMatch( ctx, ss_CHARS, p2, "took 25ミリ秒" );
+    result &= testMatch( ctx, ss_CHARS, p2, "spent 7ミリ秒" );
+    result &= !testMatch( ctx, ss_CHARS, p2, "took 25秒" );
+    
+    ss_release( ctx );
+    return result;
+}
+
+static bool test25( void ) {
+    ss_Context* ctx = ss_init();
+    
+    bool result = true;
+    
+    char const* p1 = "(digit)#4-(digit)#2-(digit)#2";
+    result &= testMatch( ctx, ss_BYTES, p1, "2024-01-31" );
+    result &= !testMatch( ctx, ss_BYTES, p1, "2024-01-3" );
+    result &= !testMatch( ctx, ss_BYTES, p1, "2024-01-311" );
+    result &= testFind( ctx, ss_BYTES, p1, "on 2024-01-31 and 2024-02-29", 2, 3 );
+    result &= testFind( ctx, ss_BYTES, p1, "2024-01-", 0, 0 );
+    
+    char const* p2 = "(char)#2..3";
+    result &= testMatch( ctx, ss_CHARS, p2, "今日" );
+    result &= testMatch( ctx, ss_CHARS, p2, "今日は" );
+    result &= !testMatch( ctx, ss_CHARS, p2, "今" );
+    result &= !testMatch( ctx, ss_CHARS, p2, "今日はい" );
+    
+    ss_release( ctx );
+    return result;
+}
+
+static bool test26( void ) {
+    ss_Context* ctx = ss_init();
+    
+    bool result = true;
+    
+    char const* p1 = "<alpha>@<alpha>.com";
+    result &= testMatch( ctx, ss_BYTES, p1, "someone@example.com" );
+    result &= !testMatch( ctx, ss_BYTES, p1, "someone@example.org" );
+    result &= !testMatch( ctx, ss_BYTES, p1, "someone@example.comm" );
+    result &= !testMatch( ctx, ss_BYTES, p1, "someone.com" );
+    
+    char const* p2 = "( 'a' | 'ab' )c";
+    result &= testMatch( ctx, ss_BYTES, p2, "ac" );
+    result &= !testMatch( ctx, ss_BYTES, p2, "abc" );
+    
+    char const* p3 = "<digit>( 'st' | 'nd' | 'rd' | 'th' ) place";
+    result &= testMatch( ctx, ss_BYTES, p3, "1st place" );
+    result &= testMatch( ctx, ss_BYTES, p3, "22nd place" );
+    result &= !testMatch( ctx, ss_BYTES, p3, "3rd places" );
+    
+    char const* p4 = "( 'は' | 'が' )<~'。' (char)>。";
+    result &= testMatch( ctx, ss_CHARS, p4, "は晴れ。" );
+    result &= !testMatch( ctx, ss_CHARS, p4, "は晴れ" );
+    
+    ss_release( ctx );
+    return result;
+}
+
+static bool test27( void ) {
+    ss_Context* ctx = ss_init();
+    
+    char const* p = "I ( { 'really':adverb ' ' }:g 'love':verb | 'like':verb ):verbal ( 'food' | 'tacos' ).";
+    char const* s = "I really really love tacos.";
+    
+    ss_Pattern* pat         = NULL;
+    ss_Text     txt         = { ss_BYTES, strlen( s ), s };
+    ss_Match*   match       = NULL;
+    ss_Match*   verbal      = NULL;
+    ss_Match*   g           = NULL;
+    ss_Match*   adverb      = NULL;
+    ss_Match*   verb        = NULL;
+    
+    pat = ss_compile( ctx, &(ss_Text){ ss_BYTES, strlen( p ), p } );
+    if( ss_errnum( ctx ) )
+        goto fail;
+    
+    match = ss_match( ctx, pat, &txt );
+    if( !match )
+        goto fail;
+    
+    verbal = ss_get( ctx, match, "verbal" );
+    if( !verbal )
+        goto fail;
+    
+    g = ss_get( ctx, verbal, "g" );
+    if( !g )
+        goto fail;
+    
+    adverb = ss_get( ctx, g, "adverb" );
+    if( !adverb )
+        goto fail;
+    if( ss_loc( ctx, adverb ) != s + 2 || ss_end( ctx, adverb ) != s + 8 )
+        goto fail;
+    
+    verb = ss_get( ctx, verbal, "verb" );
+    if( !verb )
+        goto fail;
+    if( ss_loc( ctx, verb ) != s + 16 || ss_end( ctx, verb ) != s + 20 )
+        goto fail;
+    
+    ss_release( verb );
+    ss_release( adverb );
+    ss_release( g );
+    ss_release( verbal );
+    ss_release( match );
+    ss_release( pat );
+    ss_release( ctx );
+    return true;
+
+fail:
+    if( verb )
+        ss_release( verb );
+    if( adverb )
+        ss_release( adverb );
+    if( g )
+        ss_release( g );
+    if( verbal )
+        ss_release( verbal );
+    if( match )
+        ss_release( match );
+    if( pat )
+        ss_release( pat );
+    ss_release( ctx );
+    return false;
+}
+
+static bool test28( void ) {
+    ss_Context* ctx = ss_init();
+    
+    char const* p = "I ( { 'really':adverb ' ' }:g 'love':verb | 'like':verb ):verbal ( 'food' | 'tacos' ).";
+    char const* s = "I really really love tacos.";
+    
+    ss_Pattern* pat     = NULL;
+    ss_Binding* first   = NULL;
+    ss_Binding* second  = NULL;
+    ss_Binding* third   = NULL;
+    ss_Binding* verb    = NULL;
+    ss_Text     txt     = { ss_BYTES, strlen( s ), s };
+    ss_Match*   match   = NULL;
+    ss_Match*   bound   = NULL;
+    
+    pat = ss_compile( ctx, &(ss_Text){ ss_BYTES, strlen( p ), p } );
+    if( ss_errnum( ctx ) )
+        goto fail;
+    
+    first  = ss_bind( ctx, pat, "verbal.g.adverb" );
+    second = ss_bind( ctx, pat, "verbal.g[1].adverb" );
+    third  = ss_bind( ctx, pat, "verbal.g[2].adverb" );
+    verb   = ss_bind( ctx, pat, "verbal.verb" );
+    if( ss_errnum( ctx ) )
+        goto fail;
+    
+    if( ss_bind( ctx, pat, "verbal.adjective" ) || !ss_errnum( ctx ) )
+        goto fail;
+    ss_errclr( ctx );
+    if( ss_bind( ctx, pat, "verbal..verb" ) || !ss_errnum( ctx ) )
+        goto fail;
+    ss_errclr( ctx );
+    
+    match = ss_match( ctx, pat, &txt );
+    if( !match )
+        goto fail;
+    
+    bound = ss_getBound( ctx, match, first );
+    if( !bound || ss_loc( ctx, bound ) != s + 2 || ss_end( ctx, bound ) != s + 8 )
+        goto fail;
+    ss_release( bound );
+    
+    bound = ss_getBound( ctx, match, second );
+    if( !bound || ss_loc( ctx, bound ) != s + 9 || ss_end( ctx, bound ) != s + 15 )
+        goto fail;
+    ss_release( bound );
+    
+    bound = ss_getBound( ctx, match, third );
+    if( bound )
+        goto fail;
+    
+    bound = ss_getBound( ctx, match, verb );
+    if( !bound || ss_loc( ctx, bound ) != s + 16 || ss_end( ctx, bound ) != s + 20 )
+        goto fail;
+    ss_release( bound );
+    
+    ss_release( match );
+    ss_release( verb );
+    ss_release( third );
+    ss_release( second );
+    ss_release( first );
+    ss_release( pat );
+    ss_release( ctx );
+    return true;
+
+fail:
+    if( match )
+        ss_release( match );
+    if( verb )
+        ss_release( verb );
+    if( third )
+        ss_release( third );
+    if( second )
+        ss_release( second );
+    if( first )
+        ss_release( first );
+    if( pat )
+        ss_release( pat );
+    ss_release( ctx );
+    return false;
+}
+
+static bool test29( void ) {
+    ss_Context* ctx = ss_init();
+    
+    char const* p = "n={ (digit):d \\, }:list;";
+    char const* s = "n=1,2,3,;";
+    
+    ss_Pattern* pat     = NULL;
+    ss_Text     txt     = { ss_BYTES, strlen( s ), s };
+    ss_Match*   match   = NULL;
+    ss_Match*   list    = NULL;
+    ss_Match*   item    = NULL;
+    ss_Match*   d       = NULL;
+    
+    pat = ss_compile( ctx, &(ss_Text){ ss_BYTES, strlen( p ), p } );
+    if( ss_errnum( ctx ) )
+        goto fail;
+    
+    match = ss_match( ctx, pat, &txt );
+    if( !match )
+        goto fail;
+    
+    list = ss_get( ctx, match, "list" );
+    if( !list || ss_count( ctx, list ) != 3 )
+        goto fail;
+    if( ss_loc( ctx, list ) != s + 2 || ss_end( ctx, list ) != s + 8 )
+        goto fail;
+    
+    item = ss_getIndex( ctx, list, 2 );
+    if( !item || ss_loc( ctx, item ) != s + 6 || ss_end( ctx, item ) != s + 8 )
+        goto fail;
+    
+    d = ss_get( ctx, item, "d" );
+    if( !d || ss_loc( ctx, d ) != s + 6 || ss_end( ctx, d ) != s + 7 )
+        goto fail;
+    ss_release( d );
+    
+    d = ss_get( ctx, list, "d" );
+    if( !d || ss_loc( ctx, d ) != s + 2 )
+        goto fail;
+    
+    if( ss_getIndex( ctx, list, 3 ) )
+        goto fail;
+    
+    ss_release( d );
+    ss_release( item );
+    ss_release( list );
+    ss_release( match );
+    ss_release( pat );
+    ss_release( ctx );
+    return true;
+
+fail:
+    if( d )
+        ss_release( d );
+    if( item )
+        ss_release( item );
+    if( list )
+        ss_release( list );
+    if( match )
+        ss_release( match );
+    if( pat )
+        ss_release( pat );
+    ss_release( ctx );
+    return false;
+}
+
+static bool test30( void ) {
+    ss_Context* ctx = ss_init();
+    
+    char const* p1 = "( <alpha>:key '=' <digit>:val )";
+    char const* p2 = "set (pair)[ ', ' (pair) ]:more.";
+    char const* p3 = "<digit>";
+    char const* s  = "set ab=12, c=3.";
+    
+    ss_Pattern* pair    = NULL;
+    ss_Pattern* pat     = NULL;
+    ss_Pattern* other   = NULL;
+    ss_Text     txt     = { ss_BYTES, strlen( s ), s };
+    ss_Match*   match   = NULL;
+    ss_Match*   more    = NULL;
+    
+    pair = ss_compile( ctx, &(ss_Text){ ss_BYTES, strlen( p1 ), p1 } );
+    if( ss_errnum( ctx ) )
+        goto fail;
+    ss_define( ctx, "pair", pair );
+    
+    pat = ss_compile( ctx, &(ss_Text){ ss_BYTES, strlen( p2 ), p2 } );
+    if( ss_errnum( ctx ) )
+        goto fail;
+    
+    /* The compiled pattern has its own copy of `pair`, so replacing
+       the definition leaves it unchanged. */
+    other = ss_compile( ctx, &(ss_Text){ ss_BYTES, strlen( p3 ), p3 } );
+    if( ss_errnum( ctx ) )
+        goto fail;
+    ss_define( ctx, "pair", other );
+    ss_release( pair );
+    pair = NULL;
+    
+    match = ss_match( ctx, pat, &txt );
+    if( !match )
+        goto fail;
+    
+    more = ss_get( ctx, match, "more" );
+    if( !more || ss_loc( ctx, more ) != s + 9 || ss_end( ctx, more ) != s + 14 )
+        goto fail;
+    
+    ss_release( more );
+    ss_release( match );
+    ss_release( other );
+    ss_release( pat );
+    ss_release( ctx );
+    return true;
+
+fail:
+    if( more )
+        ss_release( more );
+    if( match )
+        ss_release( match );
+    if( other )
+        ss_release( other );
+    if( pat )
+        ss_release( pat );
+    if( pair )
+        ss_release( pair );
+    ss_release( ctx );
+    return false;
+}
+
+static bool test31( void ) {
+    ss_Context* ctx = ss_init();
+    
+    char const* p = "n=(digit):d;";
+    char const* s = "n=1;";
+    
+    ss_Pattern*  pat     = NULL;
+    ss_Text      txt     = { ss_BYTES, strlen( s ), s };
+    ss_Match*    match   = NULL;
+    ss_PoolStats before, after;
+    
+    pat = ss_compile( ctx, &(ss_Text){ ss_BYTES, strlen( p ), p } );
+    if( ss_errnum( ctx ) )
+        goto fail;
+    
+    match = ss_match( ctx, pat, &txt );
+    if( !match )
+        goto fail;
+    ss_release( match );
+    
+    /* The second match reuses what the first one released. */
+    ss_poolStats( &before );
+    match = ss_match( ctx, pat, &txt );
+    if( !match )
+        goto fail;
+    ss_poolStats( &after );
+    
+    bool pooling = before.hits + before.misses > 0;
+    if( pooling && ( after.hits <= before.hits || after.peak < before.cached ) )
+        goto fail;
+    
+    ss_release( match );
+    ss_release( pat );
+    ss_release( ctx );
+    
+    ss_poolTrim();
+    ss_poolStats( &after );
+    if( after.cached != 0 || ( pooling && after.peak == 0 ) )
+        return false;
+    return true;
+
+fail:
+    if( match )
+        ss_release( match );
+    if( pat )
+        ss_release( pat );
+    ss_release( ctx );
+    return false;
+}
+
+typedef struct {
+    size_t live;
+    size_t calls;
+} Counts;
+
+static void* countAlloc( void* data, size_t size ) {
+    Counts* counts = data;
+    counts->live++;
+    counts->calls++;
+    return malloc( size );
+}
+
+static void* countResize( void* data, void* ptr, size_t size ) {
+    Counts* counts = data;
+    counts->calls++;
+    return realloc( ptr, size );
+}
+
+static void countFree( void* data, void* ptr ) {
+    Counts* counts = data;
+    counts->live--;
+    free( ptr );
+}
+
+static bool test32( void ) {
+    Counts       counts    = { 0, 0 };
+    ss_Allocator allocator = { countAlloc, countResize, countFree, &counts };
+    ss_Context*  ctx       = ss_initWith( &allocator );
+    if( !ctx || counts.calls == 0 )
+        return false;
+    
+    char const* p = "<(alpha):c>:word!";
+    char const* s = "hello!";
+    
+    ss_Pattern* pat     = NULL;
+    ss_Text     txt     = { ss_BYTES, strlen( s ), s };
+    ss_Match*   match   = NULL;
+    
+    pat = ss_compile( ctx, &(ss_Text){ ss_BYTES, strlen( p ), p } );
+    if( ss_errnum( ctx ) )
+        goto fail;
+    
+    match = ss_match( ctx, pat, &txt );
+    if( !match )
+        goto fail;
+    ss_release( match );
+    
+    /* No room for the scopes and submatches a match needs. */
+    ss_limitMemory( ctx, ss_memoryUsed( ctx ) );
+    match = ss_match( ctx, pat, &txt );
+    if( match || ss_errnum( ctx ) != ss_ERR_ALLOC )
+        goto fail;
+    
+    ss_errclr( ctx );
+    ss_limitMemory( ctx, 0 );
+    match = ss_match( ctx, pat, &txt );
+    if( !match )
+        goto fail;
+    
+    ss_release( match );
+    ss_release( pat );
+    ss_release( ctx );
+    return counts.live == 0;
+
+fail:
+    if( match )
+        ss_release( match );
+    if( pat )
+        ss_release( pat );
+    ss_release( ctx );
+    return false;
+}
+
+static bool test33( void ) {
+    ss_Context* ctx = ss_init();
+    
+    char const* p = "{ 'ab' | 'cd' }!";
+    char        s[4000];
+    for( size_t i = 0 ; i < 3998 ; i += 2 )
+        memcpy( s + i, i % 4 ? "cd" : "ab", 2 );
+    s[3998] = '!';
+    s[3999] = '\0';
+    
+    ss_Pattern* pat     = NULL;
+    ss_Text     txt     = { ss_BYTES, strlen( s ), s };
+    ss_Match*   match   = NULL;
+    
+    pat = ss_compile( ctx, &(ss_Text){ ss_BYTES, strlen( p ), p } );
+    if( ss_errnum( ctx ) )
+        goto fail;
+    
+    ss_limitSteps( ctx, 100 );
+    match = ss_match( ctx, pat, &txt );
+    if( match || ss_errnum( ctx ) != ss_ERR_TIMEOUT )
+        goto fail;
+    if( ss_errloc( ctx ) <= s || ss_errloc( ctx ) >= s + 3998 )
+        goto fail;
+    
+    ss_errclr( ctx );
+    ss_limitSteps( ctx, 0 );
+    ss_limitTime( ctx, 1 );
+    match = ss_match( ctx, pat, &txt );
+    if( match || ss_errnum( ctx ) != ss_ERR_TIMEOUT )
+        goto fail;
+    
+    ss_errclr( ctx );
+    ss_limitTime( ctx, 0 );
+    match = ss_match( ctx, pat, &txt );
+    if( !match || ss_end( ctx, match ) != s + 3999 )
+        goto fail;
+    
+    ss_release( match );
+    ss_release( pat );
+    ss_release( ctx );
+    return true;
+
+fail:
+    if( match )
+        ss_release( match );
+    if( pat )
+        ss_release( pat );
+    ss_release( ctx );
+    return false;
+}
+
+static bool test34( void ) {
+    ss_Context* ctx = ss_init();
+    
+    char const* p1 = "{ 'ab' | 'cd' }!";
+    char const* p2 = "{ { 'a' } 'b' | 'a' }";
+    char const* p3 = "(ab)-(ab)";
+    
+    ss_Pattern* pat1 = NULL;
+    ss_Pattern* pat2 = NULL;
+    ss_Pattern* pat3 = NULL;
+    ss_Pattern* ab   = NULL;
+    ss_Cost     cost;
+    
+    pat1 = ss_compile( ctx, &(ss_Text){ ss_BYTES, strlen( p1 ), p1 } );
+    if( ss_errnum( ctx ) )
+        goto fail;
+    if( ss_analyze( ctx, pat1, &cost ) )
+        goto fail;
+    if( cost.nodes < 4 || cost.bytes == 0 || cost.depth == 0 )
+        goto fail;
+    if( cost.degree != 1 || cost.rescans != 0 || cost.shared != 0 )
+        goto fail;
+    if( cost.bytesPerStep <= 0 )
+        goto fail;
+    
+    pat2 = ss_compile( ctx, &(ss_Text){ ss_BYTES, strlen( p2 ), p2 } );
+    if( ss_errnum( ctx ) )
+        goto fail;
+    if( ss_analyze( ctx, pat2, &cost ) )
+        goto fail;
+    if( cost.degree != 2 || cost.rescans == 0 )
+        goto fail;
+    
+    ab = ss_compile( ctx, &(ss_Text){ ss_BYTES, 2, "ab" } );
+    if( ss_errnum( ctx ) )
+        goto fail;
+    ss_define( ctx, "ab", ab );
+    pat3 = ss_compile( ctx, &(ss_Text){ ss_BYTES, strlen( p3 ), p3 } );
+    if( ss_errnum( ctx ) )
+        goto fail;
+    if( ss_analyze( ctx, pat3, &cost ) )
+        goto fail;
+    if( cost.shared == 0 || cost.degree != 0 || cost.unbounded )
+        goto fail;
+    
+    ss_release( pat1 );
+    ss_release( pat2 );
+    ss_release( pat3 );
+    ss_release( ab );
+    ss_release( ctx );
+    return true;
+
+fail:
+    if( pat1 )
+        ss_release( pat1 );
+    if( pat2 )
+        ss_release( pat2 );
+    if( pat3 )
+        ss_release( pat3 );
+    if( ab )
+        ss_release( ab );
+    ss_release( ctx );
+    return false;
+}
+
+static bool test35( void ) {
+    ss_Context* ctx = ss_init();
+    
+    char const* p1 = "{ <'a'..'z'>:w ' ' }:words.";
+    char const* s1 = "the quick fox .";
+    char const* p2 = "<(digit)>";
+    char const* s2 = "123";
+    char const* p3 = "\\<!--{ ~'-->' char }:body--\\>";
+    char const* s3 = "<!-- a -- b - -->";
+    
+    ss_Pattern* pat1  = NULL;
+    ss_Pattern* pat2  = NULL;
+    ss_Pattern* pat3  = NULL;
+    ss_Feed*    feed  = NULL;
+    ss_Match*   match = NULL;
+    ss_Match*   words = NULL;
+    ss_Match*   word  = NULL;
+    ss_Match*   w     = NULL;
+    
+    pat1 = ss_compile( ctx, &(ss_Text){ ss_BYTES, strlen( p1 ), p1 } );
+    if( ss_errnum( ctx ) )
+        goto fail;
+    pat2 = ss_compile( ctx, &(ss_Text){ ss_BYTES, strlen( p2 ), p2 } );
+    if( ss_errnum( ctx ) )
+        goto fail;
+    pat3 = ss_compile( ctx, &(ss_Text){ ss_BYTES, strlen( p3 ), p3 } );
+    if( ss_errnum( ctx ) )
+        goto fail;
+    
+    /* Nothing is decided until the final byte arrives. */
+    feed = ss_feed( ctx, pat1, ss_BYTES );
+    if( !feed )
+        goto fail;
+    size_t len = strlen( s1 );
+    for( size_t i = 0 ; i < len ; i++ ) {
+        match = ss_feedMore( ctx, feed, s1 + i, 1 );
+        if( i + 1 < len && ( match || ss_errnum( ctx ) != ss_ERR_MORE ) )
+            goto fail;
+        ss_errclr( ctx );
+    }
+    if( !match || ss_end( ctx, match ) - ss_loc( ctx, match ) != (long)len )
+        goto fail;
+    
+    words = ss_get( ctx, match, "words" );
+    if( !words || ss_count( ctx, words ) != 3 )
+        goto fail;
+    word = ss_getIndex( ctx, words, 1 );
+    w    = word ? ss_get( ctx, word, "w" ) : NULL;
+    if( !w || ss_end( ctx, w ) - ss_loc( ctx, w ) != 5 || memcmp( ss_loc( ctx, w ), "quick", 5 ) != 0 )
+        goto fail;
+    ss_release( w );
+    ss_release( word );
+    ss_release( words );
+    ss_release( match );
+    ss_release( feed );
+    w = word = words = match = NULL;
+    feed = NULL;
+    
+    /* A mismatch is decided as soon as it's seen. */
+    feed = ss_feed( ctx, pat1, ss_BYTES );
+    if( !feed )
+        goto fail;
+    match = ss_feedMore( ctx, feed, "ab1", 3 );
+    if( match || ss_errnum( ctx ) )
+        goto fail;
+    ss_release( feed );
+    feed = NULL;
+    
+    /* A run of digits could go on until the input is ended. */
+    feed = ss_feed( ctx, pat2, ss_BYTES );
+    if( !feed )
+        goto fail;
+    match = ss_feedMore( ctx, feed, s2, 3 );
+    if( match || ss_errnum( ctx ) != ss_ERR_MORE )
+        goto fail;
+    ss_errclr( ctx );
+    match = ss_feedEnd( ctx, feed );
+    if( !match || ss_end( ctx, match ) - ss_loc( ctx, match ) != 3 )
+        goto fail;
+    ss_release( match );
+    ss_release( feed );
+    match = NULL;
+    feed  = NULL;
+    
+    /* A lookahead that runs out of input part way through `-->` picks
+       up where it stopped when the next byte arrives. */
+    feed = ss_feed( ctx, pat3, ss_BYTES );
+    if( !feed )
+        goto fail;
+    len = strlen( s3 );
+    for( size_t i = 0 ; i < len ; i++ ) {
+        match = ss_feedMore( ctx, feed, s3 + i, 1 );
+        if( i + 1 < len && ( match || ss_errnum( ctx ) != ss_ERR_MORE ) )
+            goto fail;
+        ss_errclr( ctx );
+    }
+    if( !match || ss_end( ctx, match ) - ss_loc( ctx, match ) != (long)len )
+        goto fail;
+    
+    ss_release( match );
+    ss_release( feed );
+    ss_release( pat1 );
+    ss_release( pat2 );
+    ss_release( pat3 );
+    ss_release( ctx );
+    return true;
+
+fail:
+    if( w )
+        ss_release( w );
+    if( word )
+        ss_release( word );
+    if( words )
+        ss_release( words );
+    if( match )
+        ss_release( match );
+    if( feed )
+        ss_release( feed );
+    if( pat1 )
+        ss_release( pat1 );
+    if( pat2 )
+        ss_release( pat2 );
+    if( pat3 )
+        ss_release( pat3 );
+    ss_release( ctx );
+    return false;
+}
+
+typedef struct {
+    char const* str;
+    size_t      len;
+    size_t      at;
+    size_t      chunk;
+} Source;
+
+static size_t readSource( void* data, char* buf, size_t cap ) {
+    Source* src = data;
+    size_t  n   = src->len - src->at;
+    if( n > src->chunk )
+        n = src->chunk;
+    if( n > cap )
+        n = cap;
+    memcpy( buf, src->str + src->at, n );
+    src->at += n;
+    return n;
+}
+
+static bool test36( void ) {
+    ss_Context* ctx = ss_init();
+    
+    char const* p1 = "<'0'..'9'>";
+    char const* p2 = "needle";
+    char const* s2 = "haystack needle hay needle";
+    char const* unit = "ab 12, 345;";
+    size_t      reps = 200000;
+    size_t      ulen = strlen( unit );
+    
+    ss_Pattern* pat1    = NULL;
+    ss_Pattern* pat2    = NULL;
+    ss_Scanner* scanner = NULL;
+    ss_Match*   match   = NULL;
+    char*       s1      = malloc( ulen*reps );
+    if( !s1 )
+        goto fail;
+    for( size_t i = 0 ; i < reps ; i++ )
+        memcpy( s1 + i*ulen, unit, ulen );
+    
+    pat1 = ss_compile( ctx, &(ss_Text){ ss_BYTES, strlen( p1 ), p1 } );
+    if( ss_errnum( ctx ) )
+        goto fail;
+    pat2 = ss_compile( ctx, &(ss_Text){ ss_BYTES, strlen( p2 ), p2 } );
+    if( ss_errnum( ctx ) )
+        goto fail;
+    
+    /* Every number is found at its offset in the whole input, read a few
+       bytes at a time, without the input being held all at once. */
+    Source src1 = { s1, ulen*reps, 0, 7 };
+    scanner = ss_startReader( ctx, pat1, ss_BYTES, readSource, &src1 );
+    if( !scanner )
+        goto fail;
+    size_t found = 0;
+    size_t most  = 0;
+    while( ( match = ss_find( ctx, scanner ) ) ) {
+        size_t   at  = found/2*ulen + ( found%2 ? 7 : 3 );
+        size_t   len = found%2 ? 3 : 2;
+        uint64_t pos = ss_position( ctx, scanner, ss_loc( ctx, match ) );
+        if( pos != at || (size_t)( ss_end( ctx, match ) - ss_loc( ctx, match ) ) != len )
+            goto fail;
+        if( memcmp( ss_loc( ctx, match ), s1 + at, len ) != 0 )
+            goto fail;
+        if( ss_memoryUsed( ctx ) > most )
+            most = ss_memoryUsed( ctx );
+        ss_release( match );
+        match = NULL;
+        found++;
+    }
+    if( ss_errnum( ctx ) || found != 2*reps || most > ulen*reps/4 )
+        goto fail;
+    ss_release( scanner );
+    scanner = NULL;
+    
+    /* Literals are found even when split between reads. */
+    Source src2 = { s2, strlen( s2 ), 0, 4 };
+    scanner = ss_startReader( ctx, pat2, ss_BYTES, readSource, &src2 );
+    if( !scanner )
+        goto fail;
+    uint64_t want[] = { 9, 20 };
+    for( size_t i = 0 ; i < 2 ; i++ ) {
+        match = ss_find( ctx, scanner );
+        if( !match || ss_position( ctx, scanner, ss_loc( ctx, match ) ) != want[i] )
+            goto fail;
+        ss_release( match );
+        match = NULL;
+    }
+    if( ss_find( ctx, scanner ) || ss_errnum( ctx ) )
+        goto fail;
+    
+    ss_release( scanner );
+    ss_release( pat1 );
+    ss_release( pat2 );
+    ss_release( ctx );
+    free( s1 );
+    return true;
+
+fail:
+    if( match )
+        ss_release( match );
+    if( scanner )
+        ss_release( scanner );
+    if( pat1 )
+        ss_release( pat1 );
+    if( pat2 )
+        ss_release( pat2 );
+    ss_release( ctx );
+    free( s1 );
+    return false;
+}
+
+static bool test37( void ) {
+    ss_Context* ctx = ss_init();
+    
+    char const* p1 = "<'a'..'z'>";
+    char const* p2 = "\xC3\xA9";
+    
+    ss_Pattern* pat1    = NULL;
+    ss_Pattern* pat2    = NULL;
+    ss_Scanner* scanner = NULL;
+    ss_Match*   match   = NULL;
+    
+    pat1 = ss_compile( ctx, &(ss_Text){ ss_BYTES, strlen( p1 ), p1 } );
+    if( ss_errnum( ctx ) )
+        goto fail;
+    pat2 = ss_compile( ctx, &(ss_Text){ ss_CHARS, strlen( p2 ), p2 } );
+    if( ss_errnum( ctx ) )
+        goto fail;
+    
+    /* Words are found across slices, even an empty one, and those
+       inside a slice are matched where they are. */
+    ss_Slice s1[] = {
+        { ss_BYTES, 2, "ab" },
+        { ss_BYTES, 3, "c d" },
+        { ss_BYTES, 0, "" },
+        { ss_BYTES, 4, "ef g" }
+    };
+    char const* words[] = { "abc", "def", "g" };
+    uint64_t    at[]    = { 0, 4, 8 };
+    scanner = ss_startSlices( ctx, pat1, s1, 4 );
+    if( !scanner )
+        goto fail;
+    for( size_t i = 0 ; i < 3 ; i++ ) {
+        match = ss_find( ctx, scanner );
+        if( !match || ss_position( ctx, scanner, ss_loc( ctx, match ) ) != at[i] )
+            goto fail;
+        size_t len = strlen( words[i] );
+        if( (size_t)( ss_end( ctx, match ) - ss_loc( ctx, match ) ) != len || memcmp( ss_loc( ctx, match ), words[i], len ) != 0 )
+            goto fail;
+        if( i == 2 && ss_loc( ctx, match ) != s1[3].str + 3 )
+            goto fail;
+        ss_release( match );
+        match = NULL;
+    }
+    if( ss_find( ctx, scanner ) || ss_errnum( ctx ) )
+        goto fail;
+    ss_release( scanner );
+    scanner = NULL;
+    
+    /* A character split between slices is put back together. */
+    ss_Slice s2[] = {
+        { ss_CHARS, 4, "caf\xC3" },
+        { ss_CHARS, 4, "\xA9 ok" }
+    };
+    scanner = ss_startSlices( ctx, pat2, s2, 2 );
+    if( !scanner )
+        goto fail;
+    match = ss_find( ctx, scanner );
+    if( !match || ss_position( ctx, scanner, ss_loc( ctx, match ) ) != 3 || ss_end( ctx, match ) - ss_loc( ctx, match ) != 2 )
+        goto fail;
+    ss_release( match );
+    match = NULL;
+    if( ss_find( ctx, scanner ) || ss_errnum( ctx ) )
+        goto fail;
+    
+    ss_release( scanner );
+    ss_release( pat1 );
+    ss_release( pat2 );
+    ss_release( ctx );
+    return true;
+
+fail:
+    if( match )
+        ss_release( match );
+    if( scanner )
+        ss_release( scanner );
+    if( pat1 )
+        ss_release( pat1 );
+    if( pat2 )
+        ss_release( pat2 );
+    ss_release( ctx );
+    return false;
+}
+
+typedef struct {
+    size_t   hits[3];
+    uint64_t last[3];
+} FileHits;
+
+static int countHit( ss_Context* ctx, void* data, size_t index, ss_Match* match, uint64_t pos ) {
+    FileHits* hits = data;
+    hits->hits[index]++;
+    hits->last[index] = pos;
+    return 0;
+}
+
+static int stopHit( ss_Context* ctx, void* data, size_t index, ss_Match* match, uint64_t pos ) {
+    FileHits* hits = data;
+    hits->hits[index]++;
+    return 1;
+}
+
+/* Input 0 stops the scan, but not until the workers on the others have
+   got going, and they hold their first match until it has, so they're
+   stopped part way through.  The waits are bounded so a build without
+   threads, which scans the inputs one after another, doesn't hang. */
+#define STOP_SPINS 100000000
+typedef struct {
+    size_t hits[3];
+    int    started;
+    int    stopped;
+} StopHits;
+
+static int stopBusy( ss_Context* ctx, void* data, size_t index, ss_Match* match, uint64_t pos ) {
+    StopHits* hits = data;
+    hits->hits[index]++;
+    if( index == 0 ) {
+        for( long i = 0 ; i < STOP_SPINS && __atomic_load_n( &hits->started, __ATOMIC_ACQUIRE ) < 2 ; i++ )
+            ;
+        __atomic_store_n( &hits->stopped, 1, __ATOMIC_RELEASE );
+        return 1;
+    }
+    if( hits->hits[index] == 1 ) {
+        __atomic_add_fetch( &hits->started, 1, __ATOMIC_RELEASE );
+        for( long i = 0 ; i < STOP_SPINS && !__atomic_load_n( &hits->stopped, __ATOMIC_ACQUIRE ) ; i++ )
+            ;
+    }
+    return 0;
+}
+
+static bool test38( void ) {
+    ss_Context* ctx = ss_init();
+    
+    char const* p1 = "<'0'..'9'>";
+    char const* paths[] = { "ss_test38a.txt", "ss_test38b.txt", "ss_test38c.txt", "ss_test38d.txt" };
+    char const* texts[] = { "1 22 333", "", "no digits but 4" };
+    size_t      want[]  = { 3, 0, 1 };
+    uint64_t    last[]  = { 5, 0, 14 };
+    size_t      big     = 1 << 20;
+    
+    ss_Pattern* pat = NULL;
+    for( size_t i = 0 ; i < 4 ; i++ ) {
+        FILE* file = fopen( paths[i], "wb" );
+        if( !file )
+            goto fail;
+        if( i < 3 ) {
+            fputs( texts[i], file );
+        }
+        else {
+            for( size_t j = 0 ; j < big/2 ; j++ )
+                fputs( "7 ", file );
+        }
+        fclose( file );
+    }
+    
+    pat = ss_compile( ctx, &(ss_Text){ ss_BYTES, strlen( p1 ), p1 } );
+    if( ss_errnum( ctx ) )
+        goto fail;
+    
+    /* Every file is scanned, whichever worker takes it. */
+    FileHits hits = { { 0 }, { 0 } };
+    if( ss_scanFiles( ctx, pat, ss_BYTES, paths, 3, 2, countHit, &hits ) != 0 )
+        goto fail;
+    for( size_t i = 0 ; i < 3 ; i++ ) {
+        if( hits.hits[i] != want[i] || hits.last[i] != last[i] )
+            goto fail;
+    }
+    
+    /* A missing file is reported once the rest are scanned. */
+    char const* missing[] = { paths[0], "ss_test38_missing.txt", paths[2] };
+    hits = (FileHits){ { 0 }, { 0 } };
+    if( ss_scanFiles( ctx, pat, ss_BYTES, missing, 3, 1, countHit, &hits ) == 0 )
+        goto fail;
+    if( ss_errnum( ctx ) != ss_ERR_IO || ss_errloc( ctx ) != missing[1] )
+        goto fail;
+    if( hits.hits[0] != 3 || hits.hits[2] != 1 )
+        goto fail;
+    ss_errclr( ctx );
+    
+    /* The callback can stop the scan. */
+    hits = (FileHits){ { 0 }, { 0 } };
+    if( ss_scanFiles( ctx, pat, ss_BYTES, paths, 3, 1, stopHit, &hits ) != 0 )
+        goto fail;
+    if( hits.hits[0] + hits.hits[1] + hits.hits[2] != 1 )
+        goto fail;
+    
+    /* Once one worker's callback stops the scan, the others stop
+       delivering matches part way through their files. */
+    char const* stopped[] = { paths[0], paths[3], paths[3] };
+    StopHits    busy      = { { 0 }, 0, 0 };
+    if( ss_scanFiles( ctx, pat, ss_BYTES, stopped, 3, 3, stopBusy, &busy ) != 0 )
+        goto fail;
+    if( busy.hits[0] != 1 || busy.hits[1] >= big/2 || busy.hits[2] >= big/2 )
+        goto fail;
+    
+    for( size_t i = 0 ; i < 4 ; i++ )
+        remove( paths[i] );
+    ss_release( pat );
+    ss_release( ctx );
+    return true;
+
+fail:
+    for( size_t i = 0 ; i < 4 ; i++ )
+        remove( paths[i] );
+    if( pat )
+        ss_release( pat );
+    ss_release( ctx );
+    return false;
+}
+
+static int tallyHit( ss_Context* ctx, void* data, size_t index, ss_Match* match, uint64_t pos ) {
+    size_t* hits = data;
+    hits[index]++;
+    return 0;
+}
+
+static int peakHit( ss_Context* ctx, void* data, size_t index, ss_Match* match, uint64_t pos ) {
+    size_t* peak = data;
+    if( ss_memoryUsed( ctx ) > *peak )
+        *peak = ss_memoryUsed( ctx );
+    return 0;
+}
+
+static bool test39( void ) {
+    ss_Context* ctx = ss_init();
+    
+    char const* p1    = "<'0'..'9'>:n";
+    size_t      count = 1000;
+    size_t      big   = 1 << 20;
+    
+    ss_Pattern* pat   = NULL;
+    ss_Text*    texts = calloc( count, sizeof(ss_Text) );
+    size_t*     hits  = calloc( count, sizeof(size_t) );
+    char*       str   = malloc( big );
+    if( !texts || !hits || !str )
+        goto fail;
+    for( size_t i = 0 ; i < big ; i++ )
+        str[i] = i % 4 == 3 ? ' ' : '7';
+    
+    /* A few long texts among many short ones are all scanned. */
+    for( size_t i = 0 ; i < count ; i++ ) {
+        texts[i].fmt = ss_BYTES;
+        texts[i].str = str;
+        texts[i].len = i % 300 == 0 ? big : i % 17;
+    }
+    
+    pat = ss_compile( ctx, &(ss_Text){ ss_BYTES, strlen( p1 ), p1 } );
+    if( ss_errnum( ctx ) )
+        goto fail;
+    
+    if( ss_scanTexts( ctx, pat, texts, count, 4, tallyHit, hits ) != 0 )
+        goto fail;
+    for( size_t i = 0 ; i < count ; i++ ) {
+        if( hits[i] != ( texts[i].len + 3 )/4 )
+            goto fail;
+    }
+    
+    /* Once one worker's callback stops the scan, the others stop
+       delivering matches part way through their texts. */
+    ss_Text  stopped[3] = { { ss_BYTES, 1, str }, { ss_BYTES, big, str }, { ss_BYTES, big, str } };
+    StopHits busy       = { { 0 }, 0, 0 };
+    if( ss_scanTexts( ctx, pat, stopped, 3, 3, stopBusy, &busy ) != 0 )
+        goto fail;
+    if( busy.hits[0] != 1 || busy.hits[1] >= big/4 || busy.hits[2] >= big/4 )
+        goto fail;
+    
+    /* A memory limit is shared out between the workers, so one that a
+       single worker fits in is too tight for four. */
+    size_t peak = 0;
+    if( ss_scanTexts( ctx, pat, stopped, 3, 1, peakHit, &peak ) != 0 )
+        goto fail;
+    ss_limitMemory( ctx, ss_memoryUsed( ctx ) + 2*peak + 512 );
+    if( ss_scanTexts( ctx, pat, stopped, 3, 1, peakHit, &peak ) != 0 )
+        goto fail;
+    if( ss_scanTexts( ctx, pat, stopped, 3, 4, peakHit, &peak ) == 0 || ss_errnum( ctx ) != ss_ERR_ALLOC )
+        goto fail;
+    ss_errclr( ctx );
+    ss_limitMemory( ctx, 0 );
+    
+    ss_release( pat );
+    ss_release( ctx );
+    free( texts );
+    free( hits );
+    free( str );
+    return true;
+
+fail:
+    if( pat )
+        ss_release( pat );
+    ss_release( ctx );
+    free( texts );
+    free( hits );
+    free( str );
+    return false;
+}
+
+static bool test40( void ) {
+    ss_Context* ctx = ss_init();
+    
+    char const* p1     = "<'a'..'z'>:w-<'0'..'9'>:n";
+    char const* strs[] = { "ab-12", "ab12", "x-9", "-1", "abc-", "q-0", "zz-77", "a-b", "m-5", "" };
+    size_t      count  = sizeof(strs)/sizeof(strs[0]);
+    
+    ss_Pattern*   pat = NULL;
+    ss_Text       texts[10];
+    unsigned char bits[2] = { 0xFF, 0xFF };
+    ss_PoolStats  before, after;
+    for( size_t i = 0 ; i < count ; i++ ) {
+        texts[i].fmt = ss_BYTES;
+        texts[i].str = strs[i];
+        texts[i].len = strlen( strs[i] );
+    }
+    
+    pat = ss_compile( ctx, &(ss_Text){ ss_BYTES, strlen( p1 ), p1 } );
+    if( ss_errnum( ctx ) )
+        goto fail;
+    
+    if( ss_matchMany( ctx, pat, texts, count, bits ) != 0 )
+        goto fail;
+    if( bits[0] != 0x65 || bits[1] != 0x01 )
+        goto fail;
+    
+    /* Once the pools are warm a batch takes nothing new from the heap. */
+    ss_poolStats( &before );
+    if( ss_matchMany( ctx, pat, texts, count, bits ) != 0 )
+        goto fail;
+    ss_poolStats( &after );
+    if( after.misses != before.misses )
+        goto fail;
+    
+    /* Bad UTF-8 in one text is reported without losing the others. */
+    for( size_t i = 0 ; i < count ; i++ )
+        texts[i].fmt = ss_CHARS;
+    texts[3].str = "\xFF-1";
+    texts[3].len = strlen( texts[3].str );
+    if( ss_matchMany( ctx, pat, texts, count, bits ) != -1 )
+        goto fail;
+    if( ss_errnum( ctx ) != ss_ERR_FORMAT )
+        goto fail;
+    if( bits[0] != 0x65 || bits[1] != 0x01 )
+        goto fail;
+    ss_errclr( ctx );
+    
+    ss_release( pat );
+    ss_release( ctx );
+    return true;
+
+fail:
+    if( pat )
+        ss_release( pat );
+    ss_release( ctx );
+    return false;
+}
+
+static bool test41( void ) {
+    Counts       counts    = { 0, 0 };
+    ss_Allocator allocator = { countAlloc, countResize, countFree, &counts };
+    ss_Context*  ctx       = ss_initWith( &allocator );
+    if( !ctx )
+        return false;
+    
+    char const* p1 = "I ( { 'really':adverb ' ' }:g 'love':verb | { 'really':adverb ' ' }:g 'like':verb ):verbal ( 'food' | 'tacos' ).";
+    char const* s1 = "I really really like tacos.";
+    char const* p2 = "( 'a':x 'b':y 'c' | 'a':x 'b' 'd' ):p";
+    char const* s2 = "abd";
+    
+    ss_Pattern* pat1   = NULL;
+    ss_Pattern* pat2   = NULL;
+    ss_Match*   match  = NULL;
+    ss_Match*   verbal = NULL;
+    ss_Match*   g      = NULL;
+    ss_Match*   copy   = NULL;
+    ss_Match*   adverb = NULL;
+    ss_Match*   verb   = NULL;
+    
+    pat1 = ss_compile( ctx, &(ss_Text){ ss_BYTES, strlen( p1 ), p1 } );
+    pat2 = ss_compile( ctx, &(ss_Text){ ss_BYTES, strlen( p2 ), p2 } );
+    if( ss_errnum( ctx ) )
+        goto fail;
+    
+    /* The first alternative matches both copies of `g` before giving up
+       on 'love'.  Once the log has grown, matching makes the match and a
+       copy of the log, and nothing for the abandoned alternative. */
+    match = ss_match( ctx, pat1, &(ss_Text){ ss_BYTES, strlen( s1 ), s1 } );
+    if( !match )
+        goto fail;
+    ss_release( match );
+    
+    size_t live  = counts.live;
+    size_t calls = counts.calls;
+    match = ss_match( ctx, pat1, &(ss_Text){ ss_BYTES, strlen( s1 ), s1 } );
+    if( !match || counts.calls - calls > 2 )
+        goto fail;
+    
+    /* Scopes and copies are only made once something looks. */
+    calls  = counts.calls;
+    verbal = ss_get( ctx, match, "verbal" );
+    if( !verbal || counts.calls == calls )
+        goto fail;
+    g = ss_get( ctx, verbal, "g" );
+    if( !g || ss_count( ctx, g ) != 2 )
+        goto fail;
+    copy   = ss_getIndex( ctx, g, 1 );
+    adverb = copy ? ss_get( ctx, copy, "adverb" ) : NULL;
+    if( !adverb || ss_loc( ctx, adverb ) != s1 + 9 || ss_end( ctx, adverb ) != s1 + 15 )
+        goto fail;
+    verb = ss_get( ctx, verbal, "verb" );
+    if( !verb || ss_loc( ctx, verb ) != s1 + 16 || ss_end( ctx, verb ) != s1 + 20 )
+        goto fail;
+    
+    ss_release( verb );
+    ss_release( adverb );
+    ss_release( copy );
+    ss_release( g );
+    ss_release( verbal );
+    ss_release( match );
+    verb   = NULL;
+    adverb = NULL;
+    copy   = NULL;
+    g      = NULL;
+    verbal = NULL;
+    match  = NULL;
+    if( counts.live != live )
+        goto fail;
+    
+    /* What an abandoned alternative bound is gone. */
+    match = ss_match( ctx, pat2, &(ss_Text){ ss_BYTES, strlen( s2 ), s2 } );
+    verbal = match ? ss_get( ctx, match, "p" ) : NULL;
+    if( !verbal )
+        goto fail;
+    verb = ss_get( ctx, verbal, "x" );
+    if( !verb || ss_loc( ctx, verb ) != s2 )
+        goto fail;
+    ss_release( verb );
+    verb = ss_get( ctx, verbal, "y" );
+    if( verb )
+        goto fail;
+    
+    ss_release( verbal );
+    
+    ss_release( match );
+    ss_release( pat1 );
+    ss_release( pat2 );
+    ss_release( ctx );
+    return counts.live == 0;
+
+fail:
+    if( verb )
+        ss_release( verb );
+    if( adverb )
+        ss_release( adverb );
+    if( copy )
+        ss_release( copy );
+    if( g )
+        ss_release( g );
+    if( verbal )
+        ss_release( verbal );
+    if( match )
+        ss_release( match );
+    if( pat1 )
+        ss_release( pat1 );
+    if( pat2 )
+        ss_release( pat2 );
+    ss_release( ctx );
+    return false;
+}
+
 int main( void ) {
     bool passing = true;
     
@@ -347,6 +1887,32 @@ int main( void ) {
     passing &= test13();
     passing &= test14();
     passing &= test15();
+    passing &= test16();
+    passing &= test17();
+    passing &= test18();
+    passing &= test19();
+    passing &= test20();
+    passing &= test21();
+    passing &= test22();
+    passing &= test23();
+    passing &= test24();
+    passing &= test25();
+    passing &= test26();
+    passing &= test27();
+    passing &= test28();
+    passing &= test29();
+    passing &= test30();
+    passing &= test31();
+    passing &= test32();
+    passing &= test33();
+    passing &= test34();
+    passing &= test35();
+    passing &= test36();
+    passing &= test37();
+    passing &= test38();
+    passing &= test39();
+    passing &= test40();
+    passing &= test41();
     
     if( passing ) {
         printf( "PASSED\n" );